@@ -3,6 +3,29 @@
 #define USER_CODE_ADDRESS     0x1000
 #define TOP_CODE_ADDRESS      0x3fffc
 
+// 1: copy the image to SRAM in 8 word LDM/STM bursts with the flash
+// prefetch tuned for it, 0: one word at a time (startup_sim3u1xx.S)
+#define BOOT_COPY_BURST       1
+// Code that runs once stays in flash instead of being copied to SRAM
+// (.cold in bootloader_link.ld)
+#define BOOT_COLD             __attribute__((section(".cold")))
+
 #define UART_UPDATE_ENABLE    1
 #define UART_BAUD_RATE        115200
+// Highest rate a host can switch to (UPDATE_CMD_BAUD)
+#define UART_MAX_BAUD_RATE    1000000
+// Time after reset for the host to send HELLO
+#define UART_UPDATE_WAIT_MS   500
+// USART0 pins on the crossbar
+#define UART_PBSTD            SI32_PBSTD_0
+#define UART_TX_PIN           0x00000001
+#define UART_RX_PIN           0x00000002
+// DMA channel receiving the frames
+#define UART_DMA_CHANNEL      0
+#define UART_DMA_XBAR         SI32_DMAXBAR_CHAN0_USART0_RX
+// 1: toggle an LED (P2.10, driver enabled in mySystemInit) after every WRITE
+// frame, so an update in progress can be seen on the board
+#define UPDATE_ACTIVITY_LED   1
+#define UPDATE_LED_PBSTD      SI32_PBSTD_2
+#define UPDATE_LED_PIN        0x00000400
 #endif
@@ -25,8 +25,14 @@
 #include <SI32_PBCFG_A_Type.h>
 #include <SI32_PBSTD_A_Type.h>
 #include "config.h"
+#include "uart_update.h"
 volatile uint32_t msTicks;
 
+// Core cycles from reset until the image is in SRAM (startup_sim3u1xx.S),
+// and until main() starts waiting for a host
+uint32_t BootCopyCycles;
+uint32_t BootReadyCycles;
+
 /* other code*/
 //==============================================================================
 //1st LEVEL  INTERRUPT HANDLERS
@@ -37,7 +43,7 @@ void SysTick_Handler(void)
    /*NO SENCOND LEVEL HANDERL SPESIFIED*/
 }
 
-void mySystemInit(void)
+BOOT_COLD void mySystemInit(void)
 {
    SI32_WDTIMER_A_stop_counter (SI32_WDTIMER_0);
    // Enable the APB clock to the PB registers
@@ -61,14 +67,18 @@ void mySystemInit(void)
 //==============================================================================
 // myApplication.
 //==============================================================================
-int main()
+BOOT_COLD int main()
 {
-	unsigned int time_out;
-	while(1) {
-		time_out = msTicks + 1000;
-		while(time_out > msTicks);
-		SI32_PBSTD_A_toggle_pins(SI32_PBSTD_2, 0xC00);
-		SI32_PBSTD_A_toggle_pins(SI32_PBSTD_1, 0x003);
-	}
+	mySystemInit();
+	BootReadyCycles = DWT->CYCCNT;
+
+#if UART_UPDATE_ENABLE
+	// Wait for a host after reset, or for as long as it takes when there is
+	// no user code to run
+	uart_update_run(uart_update_user_code_valid() ? UART_UPDATE_WAIT_MS : UPDATE_WAIT_FOREVER);
+#endif
+
+	// Returning runs the user code at USER_CODE_ADDRESS (startup_sim3u1xx.S)
+	return 0;
 }
 //---eof------------------------------------------------------------------------
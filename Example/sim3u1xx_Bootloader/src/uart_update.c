@@ -0,0 +1,492 @@
+//------------------------------------------------------------------------------
+// UART firmware update
+//------------------------------------------------------------------------------
+// USART0 receives whole frames by DMA into one of two blocks while the main
+// loop erases and writes the other one to flash. The bootloader runs from
+// SRAM and the DMA keeps moving bytes while a flash operation is in
+// progress, so the transfer of a block and its programming overlap and the
+// update goes at the speed of whichever is slower. A faster baud rate can
+// be negotiated to make that the flash. See uart_update.h for the frames.
+//------------------------------------------------------------------------------
+// hal
+#include <si32_device.h>
+#include <SI32_CLKCTRL_A_Type.h>
+#include <SI32_DMACTRL_A_Type.h>
+#include <SI32_DMAXBAR_A_Type.h>
+#include <SI32_FLASHCTRL_A_Type.h>
+#include <SI32_PBCFG_A_Type.h>
+#include <SI32_PBSTD_A_Type.h>
+#include <SI32_USART_A_Type.h>
+// application
+#include "config.h"
+#include "uart_update.h"
+
+extern volatile uint32_t msTicks;
+
+#define FLASH_PAGE_SIZE   0x400
+#define FLASH_ERASED      0xFFFFFFFF
+
+// The last page holds the lock word and is never erased
+#define FLASH_USER_END    (TOP_CODE_ADDRESS & ~(FLASH_PAGE_SIZE - 1))
+#define FLASH_PAGES       (FLASH_USER_END / FLASH_PAGE_SIZE)
+
+// Runs of erased words at least this long are skipped, not written
+#define FLASH_SKIP_MIN_WORDS 4
+
+//==============================================================================
+// DMA
+//==============================================================================
+#define DMA_CHANNELS 16
+
+// Channel control structure, as the controller (ARM PL230) reads it
+typedef struct dma_descriptor_struct
+{
+   volatile void *   src_end;
+   volatile void *   dst_end;
+   volatile uint32_t control;
+   uint32_t          unused;
+} dma_descriptor_type;
+
+// Bytes from the USART data register into a frame buffer
+#define DMA_CONTROL_RX_FRAME  ((0u << 30) |   /* dst inc byte */       \
+                               (0u << 28) |   /* dst size byte */      \
+                               (3u << 26) |   /* src inc none */       \
+                               (0u << 24) |   /* src size byte */      \
+                               ((UPDATE_FRAME_SIZE - 1) << 4) |        \
+                               (1u))          /* basic cycle */
+#define DMA_CONTROL_CYCLE_MASK     0x7
+#define DMA_CONTROL_N_MINUS_1(c)   (((c) >> 4) & 0x3FF)
+
+// The controller needs the table aligned to its size
+static dma_descriptor_type dma_descriptors[DMA_CHANNELS]
+   __attribute__ ((aligned (DMA_CHANNELS * 16)));
+
+//==============================================================================
+// Receive Blocks
+//==============================================================================
+static uint32_t rx_frame[UPDATE_BLOCK_COUNT][(UPDATE_FRAME_SIZE + 3) / 4];
+
+// Block the DMA is filling
+static uint32_t rx_fill;
+
+// Pages erased during this update
+static uint32_t flash_erased[(FLASH_PAGES + 31) / 32];
+
+// CRC16-CCITT (poly 0x1021) lookup table
+static const uint16_t crc16_table[256] =
+{
+   0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+   0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+   0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+   0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+   0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+   0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+   0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+   0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+   0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+   0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+   0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+   0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+   0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+   0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+   0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+   0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+   0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+   0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+   0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+   0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+   0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+   0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+   0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+   0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+   0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+   0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+   0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+   0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+   0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+   0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+   0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+   0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+//------------------------------------------------------------------------------
+static uint16_t crc16(const uint8_t *data, uint32_t length)
+{
+   uint16_t crc = 0xFFFF;
+
+   while (length--)
+      crc = (crc << 8) ^ crc16_table[(crc >> 8) ^ *data++];
+   return crc;
+}
+
+//==============================================================================
+// USART0
+//==============================================================================
+
+//------------------------------------------------------------------------------
+// baud = APB / (2 * divider), with the divider rounded to the nearest. 0 if
+// the baud rate is above UART_MAX_BAUD_RATE or more than 2% off.
+static uint32_t usart_baud_divider(uint32_t baud)
+{
+   uint32_t divider, actual;
+
+   if (baud == 0 || baud > UART_MAX_BAUD_RATE)
+      return 0;
+
+   divider = (SystemCoreClock + baud) / (2 * baud);
+   if (divider == 0)
+      return 0;
+   actual = SystemCoreClock / (2 * divider);
+   if ((actual > baud ? actual - baud : baud - actual) * 50 > baud)
+      return 0;
+   return divider;
+}
+
+//------------------------------------------------------------------------------
+static void usart_set_divider(uint32_t divider)
+{
+   SI32_USART_A_set_tx_baudrate(SI32_USART_0, divider - 1);
+   SI32_USART_A_set_rx_baudrate(SI32_USART_0, divider - 1);
+}
+
+//------------------------------------------------------------------------------
+BOOT_COLD static void usart_init(void)
+{
+   SI32_CLKCTRL_A_enable_apb_to_modules_0(SI32_CLKCTRL_0,
+                                          SI32_CLKCTRL_A_APBCLKG0_USART0 |
+                                          SI32_CLKCTRL_A_APBCLKG0_DMAXBAR0);
+
+   // TX push-pull, RX digital input, USART0 on the crossbar
+   SI32_PBSTD_A_set_pins_push_pull_output(UART_PBSTD, UART_TX_PIN);
+   SI32_PBSTD_A_set_pins_digital_input(UART_PBSTD, UART_RX_PIN);
+   SI32_PBCFG_A_enable_xbar0h_peripherals(SI32_PBCFG_0, SI32_PBCFG_A_XBAR0H_USART0EN);
+
+   // 8 data bits, no parity, 1 stop bit, asynchronous
+   SI32_USART_A_enter_full_duplex_mode(SI32_USART_0);
+   SI32_USART_A_select_tx_asynchronous_mode(SI32_USART_0);
+   SI32_USART_A_select_rx_asynchronous_mode(SI32_USART_0);
+   SI32_USART_A_select_tx_data_length(SI32_USART_0, 8);
+   SI32_USART_A_select_rx_data_length(SI32_USART_0, 8);
+   SI32_USART_A_disable_tx_parity_bit(SI32_USART_0);
+   SI32_USART_A_disable_rx_parity_bit(SI32_USART_0);
+   SI32_USART_A_select_tx_stop_bits(SI32_USART_0, SI32_USART_A_STOP_BITS_1_BIT);
+   SI32_USART_A_select_rx_stop_bits(SI32_USART_0, SI32_USART_A_STOP_BITS_1_BIT);
+   usart_set_divider(usart_baud_divider(UART_BAUD_RATE));
+
+   // Received bytes request DMA transfers
+   SI32_USART_A_enable_rx_dma_requests(SI32_USART_0);
+   SI32_USART_A_enable_tx(SI32_USART_0);
+   SI32_USART_A_enable_rx(SI32_USART_0);
+
+   SI32_CLKCTRL_A_enable_ahb_to_dma_controller(SI32_CLKCTRL_0);
+   SI32_DMACTRL_A_write_baseptr(SI32_DMACTRL_0, (uint32_t) dma_descriptors);
+   SI32_DMACTRL_A_enable_module(SI32_DMACTRL_0);
+   SI32_DMAXBAR_A_select_channel_peripheral(SI32_DMAXBAR_0, UART_DMA_XBAR);
+   SI32_DMACTRL_A_enable_data_request(SI32_DMACTRL_0, UART_DMA_CHANNEL);
+}
+
+//------------------------------------------------------------------------------
+static void usart_send(const uint8_t *data, uint32_t length)
+{
+   while (length--)
+   {
+      while (SI32_USART_A_read_tx_fifo_count(SI32_USART_0) >= 4);
+      SI32_USART_A_write_data_u8(SI32_USART_0, *data++);
+   }
+}
+
+//------------------------------------------------------------------------------
+static void usart_wait_tx_complete(void)
+{
+   while (SI32_USART_A_read_tx_fifo_count(SI32_USART_0)
+          || SI32_USART_A_is_tx_busy(SI32_USART_0));
+}
+
+//------------------------------------------------------------------------------
+// Stops the USART, the DMA and SysTick so the user code starts from reset
+// state.
+BOOT_COLD static void usart_stop(void)
+{
+   SI32_DMACTRL_A_disable_channel(SI32_DMACTRL_0, UART_DMA_CHANNEL);
+   SI32_DMACTRL_A_disable_module(SI32_DMACTRL_0);
+   SI32_USART_A_disable_rx_dma_requests(SI32_USART_0);
+   SI32_USART_A_disable_rx(SI32_USART_0);
+   SI32_USART_A_disable_tx(SI32_USART_0);
+   SysTick->CTRL = 0;
+}
+
+//==============================================================================
+// Frame Reception
+//==============================================================================
+
+//------------------------------------------------------------------------------
+static void rx_arm(uint32_t block)
+{
+   dma_descriptor_type *d = &dma_descriptors[UART_DMA_CHANNEL];
+
+   d->src_end = &SI32_USART_0->DATA;
+   d->dst_end = (uint8_t *)rx_frame[block] + UPDATE_FRAME_SIZE - 1;
+   d->control = DMA_CONTROL_RX_FRAME;
+   SI32_DMACTRL_A_enable_channel(SI32_DMACTRL_0, UART_DMA_CHANNEL);
+}
+
+//------------------------------------------------------------------------------
+// Bytes the DMA has still to receive, 0 once the frame is complete
+static uint32_t rx_left(void)
+{
+   uint32_t control = dma_descriptors[UART_DMA_CHANNEL].control;
+
+   if ((control & DMA_CONTROL_CYCLE_MASK) == 0)
+      return 0;
+   return DMA_CONTROL_N_MINUS_1(control) + 1;
+}
+
+//------------------------------------------------------------------------------
+// Drops the frame being received and whatever follows it until the line has
+// been quiet for UPDATE_IDLE_MS, then receives into rx_fill again.
+static void rx_resync(void)
+{
+   uint32_t quiet = msTicks;
+
+   SI32_DMACTRL_A_disable_channel(SI32_DMACTRL_0, UART_DMA_CHANNEL);
+   while (msTicks - quiet < UPDATE_IDLE_MS)
+   {
+      if (SI32_USART_A_read_rx_fifo_count(SI32_USART_0))
+      {
+         SI32_USART_A_read_data_u8(SI32_USART_0);
+         quiet = msTicks;
+      }
+   }
+   rx_arm(rx_fill);
+}
+
+//------------------------------------------------------------------------------
+// Waits for a frame in rx_fill. A frame that stops arriving for
+// UPDATE_FRAME_TIMEOUT_MS is dropped. Returns false if wait_ms passed first
+// (UPDATE_WAIT_FOREVER never passes).
+static bool rx_wait(uint32_t start, uint32_t wait_ms)
+{
+   uint32_t left, last_left = UPDATE_FRAME_SIZE;
+   uint32_t last_tick = msTicks;
+
+   while ((left = rx_left()) != 0)
+   {
+      if (left != last_left)
+      {
+         last_left = left;
+         last_tick = msTicks;
+      }
+      else if (left != UPDATE_FRAME_SIZE
+               && msTicks - last_tick > UPDATE_FRAME_TIMEOUT_MS)
+      {
+         rx_resync();
+         last_left = UPDATE_FRAME_SIZE;
+         last_tick = msTicks;
+      }
+      if (wait_ms != UPDATE_WAIT_FOREVER && msTicks - start >= wait_ms)
+         return false;
+   }
+   return true;
+}
+
+//==============================================================================
+// Flash
+//==============================================================================
+
+//------------------------------------------------------------------------------
+static void flash_unlock(void)
+{
+   SI32_FLASHCTRL_A_write_flash_key(SI32_FLASHCTRL_0, 0xA5);
+   SI32_FLASHCTRL_A_write_flash_key(SI32_FLASHCTRL_0, 0xF2);
+}
+
+//------------------------------------------------------------------------------
+static void flash_lock(void)
+{
+   while (SI32_FLASHCTRL_A_is_flash_busy(SI32_FLASHCTRL_0));
+   SI32_FLASHCTRL_A_write_flash_key(SI32_FLASHCTRL_0, 0x5A);
+}
+
+//------------------------------------------------------------------------------
+static void flash_erase_page(uint32_t address)
+{
+   SI32_FLASHCTRL_A_enter_flash_erase_mode(SI32_FLASHCTRL_0);
+   SI32_FLASHCTRL_A_write_wraddr(SI32_FLASHCTRL_0, address);
+   flash_unlock();
+   // A dummy data write starts the erase
+   SI32_FLASHCTRL_A_write_wrdata(SI32_FLASHCTRL_0, 0);
+   flash_lock();
+   SI32_FLASHCTRL_A_exit_flash_erase_mode(SI32_FLASHCTRL_0);
+}
+
+//------------------------------------------------------------------------------
+// Sequential halfword writes. Runs of erased words only move the address.
+static void flash_write_words(uint32_t address, const uint32_t *data, uint32_t words)
+{
+   uint32_t x = 0, run;
+
+   SI32_FLASHCTRL_A_exit_flash_erase_mode(SI32_FLASHCTRL_0);
+   SI32_FLASHCTRL_A_write_wraddr(SI32_FLASHCTRL_0, address);
+   SI32_FLASHCTRL_A_enter_multi_byte_write_mode(SI32_FLASHCTRL_0);
+   flash_unlock();
+
+   while (x < words)
+   {
+      run = x;
+      while (run < words && data[run] == FLASH_ERASED)
+         run++;
+      if (run - x >= FLASH_SKIP_MIN_WORDS || run == words)
+      {
+         x = run;
+         if (x < words)
+         {
+            while (SI32_FLASHCTRL_A_is_flash_busy(SI32_FLASHCTRL_0));
+            SI32_FLASHCTRL_A_write_wraddr(SI32_FLASHCTRL_0, address + x * 4);
+         }
+         continue;
+      }
+
+      while (SI32_FLASHCTRL_A_is_buffer_full(SI32_FLASHCTRL_0));
+      SI32_FLASHCTRL_A_write_wrdata(SI32_FLASHCTRL_0, data[x] & 0xFFFF);
+      while (SI32_FLASHCTRL_A_is_buffer_full(SI32_FLASHCTRL_0));
+      SI32_FLASHCTRL_A_write_wrdata(SI32_FLASHCTRL_0, data[x] >> 16);
+      x++;
+   }
+
+   flash_lock();
+   SI32_FLASHCTRL_A_exit_multi_byte_write_mode(SI32_FLASHCTRL_0);
+}
+
+//------------------------------------------------------------------------------
+// Erases the pages the block touches for the first time, writes the block
+// and reads it back.
+static uint8_t flash_write_block(uint32_t address, const uint32_t *data, uint32_t words)
+{
+   uint32_t page, x;
+
+   if ((address & 3) || words > UPDATE_BLOCK_WORDS
+       || address < USER_CODE_ADDRESS || address + words * 4 > FLASH_USER_END)
+      return UPDATE_STATUS_RANGE;
+
+   for (page = address / FLASH_PAGE_SIZE;
+        words && page <= (address + words * 4 - 1) / FLASH_PAGE_SIZE; page++)
+   {
+      if (!(flash_erased[page / 32] & (1u << (page % 32))))
+      {
+         flash_erase_page(page * FLASH_PAGE_SIZE);
+         flash_erased[page / 32] |= 1u << (page % 32);
+      }
+   }
+
+   flash_write_words(address, data, words);
+
+   for (x = 0; x < words; x++)
+   {
+      if (((const uint32_t *) address)[x] != data[x])
+         return UPDATE_STATUS_FAILED;
+   }
+   return UPDATE_STATUS_OK;
+}
+
+//==============================================================================
+// Update
+//==============================================================================
+
+//------------------------------------------------------------------------------
+BOOT_COLD bool uart_update_user_code_valid(void)
+{
+   const uint32_t *vectors = (const uint32_t *) USER_CODE_ADDRESS;
+   uint32_t sp = vectors[0], pc = vectors[1];
+
+   return (sp & 3) == 0 && sp > 0x20000000 && sp <= 0x20008000
+          && (pc & 1) && (pc & ~1) >= USER_CODE_ADDRESS && (pc & ~1) < FLASH_USER_END;
+}
+
+//------------------------------------------------------------------------------
+void uart_update_run(uint32_t wait_ms)
+{
+   uint32_t start = msTicks;
+   uint8_t *frame;
+   uint32_t address, words, divider;
+   uint8_t response[3];
+   bool hello = false, go = false;
+
+   usart_init();
+   rx_fill = 0;
+   rx_arm(rx_fill);
+
+   while (!go)
+   {
+      if (!rx_wait(start, hello ? UPDATE_WAIT_FOREVER : wait_ms))
+         break;
+
+      frame = (uint8_t *) rx_frame[rx_fill];
+      if (frame[0] != UPDATE_SOF)
+      {
+         // Out of step with the host, or its resync pattern
+         rx_resync();
+         continue;
+      }
+
+      // The next frame goes into the other block while this one is handled
+      rx_fill ^= 1;
+      rx_arm(rx_fill);
+
+      address = frame[4] | (frame[5] << 8) | (frame[6] << 16) | ((uint32_t) frame[7] << 24);
+      words = frame[3];
+      divider = 0;
+      response[1] = frame[2];
+
+      // The CRC over CMD through CRC16 is zero when the frame is intact
+      if (crc16(frame + 1, UPDATE_FRAME_SIZE - 1) != 0)
+      {
+         response[2] = UPDATE_STATUS_FAILED;
+      }
+      else
+      {
+         switch (frame[1])
+         {
+         case UPDATE_CMD_HELLO:
+            hello = true;
+            response[2] = UPDATE_STATUS_OK;
+            break;
+
+         case UPDATE_CMD_BAUD:
+            // Switched once the response is out at the old rate
+            divider = usart_baud_divider(address);
+            response[2] = divider ? UPDATE_STATUS_OK : UPDATE_STATUS_BAUD;
+            break;
+
+         case UPDATE_CMD_WRITE:
+            response[2] = flash_write_block(address, (const uint32_t *)(frame + UPDATE_HEADER_SIZE), words);
+#if UPDATE_ACTIVITY_LED
+            SI32_PBSTD_A_toggle_pins(UPDATE_LED_PBSTD, UPDATE_LED_PIN);
+#endif
+            break;
+
+         case UPDATE_CMD_GO:
+            go = uart_update_user_code_valid();
+            response[2] = go ? UPDATE_STATUS_OK : UPDATE_STATUS_FAILED;
+            break;
+
+         default:
+            response[2] = UPDATE_STATUS_INVALID;
+            break;
+         }
+      }
+
+      response[0] = (response[2] == UPDATE_STATUS_OK) ? UPDATE_RSP_ACK : UPDATE_RSP_NAK;
+      usart_send(response, sizeof(response));
+
+      if (divider)
+      {
+         usart_wait_tx_complete();
+         usart_set_divider(divider);
+      }
+   }
+
+   usart_wait_tx_complete();
+   usart_stop();
+}
+
+//-eof--------------------------------------------------------------------------
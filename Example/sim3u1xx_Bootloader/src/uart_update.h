@@ -0,0 +1,70 @@
+//------------------------------------------------------------------------------
+// UART firmware update
+//------------------------------------------------------------------------------
+// The frames are those of the adapter's UART image stream
+// (SW_Interface/uart_stream.h), except that every frame has the full
+// UPDATE_BLOCK_WORDS payload so the DMA can take it in one piece:
+//
+//   SOF | CMD | SEQ | WORDS | ADDR[4] | PAYLOAD[UPDATE_BLOCK_WORDS * 4] | CRC16[2]
+//
+// WORDS is the number of payload words that count, the rest is padding. The
+// CRC16 is CCITT (poly 0x1021, init 0xFFFF, MSB first) over CMD through
+// PAYLOAD. Each frame is answered with RSP, SEQ and a status code. The host
+// keeps at most UPDATE_BLOCK_COUNT frames outstanding: the next frame
+// arrives while the previous one is erased and written to flash.
+//
+// A host that loses a response sends UPDATE_FRAME_SIZE zero bytes and waits.
+// The bootloader drops a frame that is not complete after
+// UPDATE_FRAME_TIMEOUT_MS and waits for the line to go quiet before it
+// receives again.
+//------------------------------------------------------------------------------
+
+#ifndef __UART_UPDATE_H__
+#define __UART_UPDATE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define UPDATE_SOF              0xA5
+
+// Commands
+#define UPDATE_CMD_HELLO        'H'   // Stay in the bootloader
+#define UPDATE_CMD_BAUD         'B'   // Switch to the baud rate in ADDR after the response
+#define UPDATE_CMD_WRITE        'W'   // Write WORDS words at ADDR, erasing pages first
+#define UPDATE_CMD_GO           'G'   // Leave the bootloader and run the user code
+
+// Responses
+#define UPDATE_RSP_ACK          'K'
+#define UPDATE_RSP_NAK          'N'
+
+// Status codes
+#define UPDATE_STATUS_OK        0x55
+#define UPDATE_STATUS_INVALID   0x80  // unknown command
+#define UPDATE_STATUS_FAILED    0x81  // CRC, frame or flash error
+#define UPDATE_STATUS_RANGE     0x86  // outside the user code area
+#define UPDATE_STATUS_BAUD      0x87  // baud rate not reachable
+
+// Receive buffers (ping-pong) and their payload size
+#define UPDATE_BLOCK_COUNT      2
+#define UPDATE_BLOCK_WORDS      64
+
+#define UPDATE_HEADER_SIZE      8     // SOF through ADDR
+#define UPDATE_FRAME_SIZE       (UPDATE_HEADER_SIZE + UPDATE_BLOCK_WORDS * 4 + 2)
+
+#define UPDATE_FRAME_TIMEOUT_MS 20
+#define UPDATE_IDLE_MS          5
+
+// wait_ms that never passes
+#define UPDATE_WAIT_FOREVER     0xFFFFFFFF
+
+// True if the user code area holds a plausible vector table.
+extern bool uart_update_user_code_valid(void);
+
+// Waits up to wait_ms for a HELLO frame and, if one came, runs the update
+// until GO. Returns with the UART, DMA and SysTick stopped, ready to run the
+// user code.
+extern void uart_update_run(uint32_t wait_ms);
+
+#endif //__UART_UPDATE_H__
+
+//-eof--------------------------------------------------------------------------
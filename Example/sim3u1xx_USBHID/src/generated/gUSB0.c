@@ -56,6 +56,16 @@ void USB0_IRQHandler(void)
     USB0_ep1_in_handler();
   }
 
+  if (usbEpInterruptMask & SI32_USB_A_IOINT_IN2I_MASK )
+  {
+    USB0_ep2_in_handler();
+  }
+
+  if (usbEpInterruptMask & SI32_USB_A_IOINT_OUT2I_MASK )
+  {
+    USB0_ep2_out_handler();
+  }
+
   // Handle Start of Frame Interrupt
   if (usbCommonInterruptMask & SI32_USB_A_CMINT_SOFI_MASK)
   {
@@ -14,86 +14,112 @@
 // application
 #include "gModes.h"
 #include "myCapsense0.h"
+#include "myCLKCTRL.h"
 #include "myCpu.h"
+#include "myScheduler.h"
+#include "myTIMER1.h"
 #include "myUsbDevice.h"
 #include "myUSB0.h"
 
+//==============================================================================
+// Tasks
+//==============================================================================
+static void capsense_task(void);
+static void hid_task(void);
+static void led_task(void);
+
+static mySchedTaskType s_CapsenseTask = MYSCHED_TASK(capsense_task, CS_SCAN_PERIOD_MS);
+static mySchedTaskType s_HidTask      = MYSCHED_TASK(hid_task, 0);
+static mySchedTaskType s_LedTask      = MYSCHED_TASK(led_task, 0);
+
+// Key of the last key-down report, -1 after a key-up
+static int s_TransmitKeyLast = -1;
+
+//------------------------------------------------------------------------------
+// Every CS_SCAN_PERIOD_MS
+static void capsense_task(void)
+{
+   // TRIGGER CAPSENSE
+   scan_slider();
+   if( CapsenseTouch && (s_TransmitKeyLast!=CapsenseTouchPos))
+   {
+     // key-down event.
+     s_TransmitKeyLast = CapsenseTouchPos ;
+     myHidTransmitKey(s_TransmitKeyLast);
+     mySched_post(&s_HidTask);
+   }
+   else if ( (s_TransmitKeyLast!=-1) && (!CapsenseTouch) )
+   {
+     // key-up event.
+     s_TransmitKeyLast = -1;
+     myHidTransmitKey(16) ;
+     mySched_post(&s_HidTask);
+   }
+
+   mySched_post(&s_LedTask);
+}
+
+//------------------------------------------------------------------------------
+// After a key event, then every ms while a report waits for room in the ring
+static void hid_task(void)
+{
+   if (myHidService())
+   {
+      mySched_start(&s_HidTask, 1);
+   }
+}
+
+//------------------------------------------------------------------------------
+// After every slider scan
+static void led_task(void)
+{
+   // UPDATE STATUS OF TOUCH DETECTED LED
+   SI32_PBSTD_A_write_pins_masked(SI32_PBSTD_2,
+                                  (!CapsenseTouch) << 0xB,
+                                  0x800);
+
+   // Led brightness is 1 of 10 levels determined by the captouch slider
+   // (time on doubles between each level)
+   myTIMER1_led_pwm_set(1 << CapsenseTouchPos);
+}
+
 //==============================================================================
 // myApplication.
 //==============================================================================
 int main()
 {
-   // msTicks increments every 1ms (1Khz). Driven by boot osc (myCpu.c)
-   // _last variables store the last seen state of variables so we know when they have changed
-   uint32_t msTicks_last=0xffffffff;
-   volatile int transmitKeyLast=-1;
-  
-   // increments every main loop;
-   uint32_t count=0;
-
   // Enter the default operating mode for this application
   enter_default_mode_from_reset();
 
+#ifdef MYCLK_BENCHMARK
+  // Workload speed at each clock profile, see myCLKCTRL_benchmark_results
+  myCLKCTRL_benchmark();
+#endif
+
+  // Up from the 20 MHz reset clock before anything measures time
+  myCLKCTRL_set_profile(MYCLK_STARTUP_PROFILE);
+
   //Run initial capsens basline caibration
   calibrate_capsense();
 
+#ifdef USB0_FIFO_BENCHMARK
+  // Cycles per 64-byte FIFO packet, see USB0_fifo_benchmark_cycles
+  USB0_fifo_benchmark();
+#endif
+
+  // Drive the LED brightness from TIMER1
+  myTIMER1_led_pwm_start();
+
   // Connect to USB
   USB0_connect();
 
-   //PERFORM THE FOLLOWING TASKS FOREVER
-   while (1)
-   {
-      // if msTicks has changed
-      if (msTicks != msTicks_last)
-      {
-         // SAMPLE CAPOUCH EVERY .1S
-         if (!(msTicks % 100))
-         {
-            // TRIGGER CAPSENSE
-            scan_slider();
-            if( CapsenseTouch && (transmitKeyLast!=CapsenseTouchPos))
-            {
-              // key-down event.
-              transmitKeyLast = CapsenseTouchPos ;
-              myHidTransmitKey(transmitKeyLast);
-            }
-            else if ( (transmitKeyLast!=-1) && (!CapsenseTouch) )
-            {
-              // key-up event.
-              transmitKeyLast = -1;
-              myHidTransmitKey(16) ;
-            }
-         }           
-
-
-         // UPDATE STATUS OF TOUCH DETECTED LED
-         SI32_PBSTD_A_write_pins_masked(SI32_PBSTD_2,
-                                                 (!CapsenseTouch) << 0xB,
-                                                 0x800);
-
-         // save current msTicks value as last seen
-        msTicks_last = msTicks;
-     }// if msTicks changed
-
-     // EVERY 2^10 counts
-     if (!(count % (1024)))
-     {
-        // TURN ON LED driver (P2.10)
-        SI32_PBSTD_A_write_pins_low(SI32_PBSTD_2, 0x400);
-     }
-
-     // 2^CapsenseTouchPos counts after led driver on
-     if ((count % 1024) == (1 << CapsenseTouchPos))
-     {
-        // TURN OFF LED driver (P2.10)
-        SI32_PBSTD_A_write_pins_high(SI32_PBSTD_2, 0x400);
-        // Led brightness will now be 1 of 10 levels determined by the
-        // captouch slider (time on doubles betweeneach level)
-     }
-
-     count++;
-   }//while(1)
+  // PERFORM THE TASKS FOREVER, SLEEPING IN BETWEEN
+  mySched_add(&s_CapsenseTask);
+  mySched_add(&s_HidTask);
+  mySched_add(&s_LedTask);
+  mySched_add(&myCLKCTRL_task);
+  mySched_start(&s_CapsenseTask, 0);
+  mySched_run();
 }
 
 //-eof--------------------------------------------------------------------------
-
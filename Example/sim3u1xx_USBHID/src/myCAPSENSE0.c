@@ -10,31 +10,72 @@
 #include <stdio.h>
 #include <si32_device.h>
 #include <SI32_CAPSENSE_A_Type.h>
+#include <SI32_DMACTRL_A_Type.h>
+#include <SI32_DMAXBAR_A_Type.h>
 // application
 #include "myCAPSENSE0.h"
+#include "myDMACTRL0.h"
 
 #define printf(...)
 
+// NUMBER OF SLIDER CHANNELS
+#define CS_CHANNELS 6
+
+#if CS_AUTO_SCAN
+// AUTO-SCAN OF CS0-3, CS8-9. THE MODULE SCANS IN ASCENDING CHANNEL ORDER,
+// WHICH IS THE ORDER OF CS_info.channels
+#define CS_SCAN_MASK       0x030F
+
+// DMA CHANNEL MOVING EACH RESULT FROM DATA INTO CS_info.readings
+#define CS_DMA_CHANNEL     0
+#define CS_DMA_IRQn        DMACH0_IRQn
+#define CS_DMA_IRQHandler  DMACH0_IRQHandler
+#define CS_DMA_CONTROL     (DMA_CONTROL_DST_INC_WORD | DMA_CONTROL_DST_SIZE_WORD | \
+                            DMA_CONTROL_SRC_INC_NONE | DMA_CONTROL_SRC_SIZE_WORD | \
+                            DMA_CONTROL_R_POWER(0) | \
+                            DMA_CONTROL_N_MINUS_1(CS_CHANNELS - 1) | \
+                            DMA_CONTROL_CYCLE_BASIC)
+#endif
+
 // PUBLIC VARIABLES
 uint8_t CapsenseTouchPos;
 bool CapsenseTouch;
+volatile uint32_t CapsenseWorstCycles;
 
 // CAPSENS CALCULATION and INFO STRUCT
 struct capsensTracking_struct
 {
   bool scanning;
   uint32_t chan;
-  uint32_t channels[6];
-  uint32_t readings[6];
-  uint32_t baseline[6];
+  uint32_t channels[CS_CHANNELS];
+  uint32_t readings[CS_CHANNELS];
+  uint32_t baseline[CS_CHANNELS];
+  // Touch thresholds, (baseline + 0x100) * 1.2 rounded down. A reading is a
+  // touch when it is greater, which is the same test for whole numbers.
+  uint32_t threshold[CS_CHANNELS];
 } CS_info;
 
 //==============================================================================
 //2nd LEVEL INTERRUPT HANDLERS
 //==============================================================================
-void calculate_position(uint8_t); //defined below
+void calculate_position(void); //defined below
+
+//------------------------------------------------------------------------------
+static void track_cycles(uint32_t start)
+{
+    // TRACK THE LONGEST TIME SPENT IN A CAPSENSE HANDLER
+    uint32_t cycles = DWT->CYCCNT - start;
+    if (cycles > CapsenseWorstCycles)
+    {
+      CapsenseWorstCycles = cycles;
+    }
+}
+
+//------------------------------------------------------------------------------
 void my_convert_complete_handler(void)
 {
+    uint32_t start = DWT->CYCCNT;
+
     // SAVE READING
     CS_info.readings[CS_info.chan] = SI32_CAPSENSE_A_read_data(SI32_CAPSENSE_0);
 
@@ -43,7 +84,7 @@ void my_convert_complete_handler(void)
     SI32_CAPSENSE_A_disable_module(SI32_CAPSENSE_0);
 
     // IF WE HAVE CHANNELS LEFT TO SCAN
-    if (CS_info.chan < 5)
+    if (CS_info.chan < CS_CHANNELS - 1)
     {
        // POINT TO NEXT CHANNEL
        SI32_CAPSENSE_A_write_mux(SI32_CAPSENSE_0, CS_info.channels[++CS_info.chan]);
@@ -62,11 +103,29 @@ void my_convert_complete_handler(void)
       // DISCONNECT FROM PINS
       SI32_CAPSENSE_A_connect_capsense_channel(SI32_CAPSENSE_0);
 
-      // AND CALCULATE POSITION (interpolate 5 codes per segment)
-      calculate_position(2);
+      // AND CALCULATE POSITION
+      calculate_position();
     }
+
+    track_cycles(start);
 }
 
+#if CS_AUTO_SCAN
+//------------------------------------------------------------------------------
+// DMA has collected a whole frame: the one interrupt of an auto-scan
+void CS_DMA_IRQHandler(void)
+{
+    uint32_t start = DWT->CYCCNT;
+
+    SI32_CAPSENSE_A_disable_module(SI32_CAPSENSE_0);
+    CS_info.scanning = false;
+
+    calculate_position();
+
+    track_cycles(start);
+}
+#endif
+
 //------------------------------------------------------------------------------
 void my_scan_complete_handler(void)
 {
@@ -74,6 +133,25 @@ void my_scan_complete_handler(void)
 }
 
 //------------------------------------------------------------------------------
+#if CS_AUTO_SCAN
+void scan_slider(void)
+{
+   // THE LAST FRAME IS STILL BEING COLLECTED
+   if (CS_info.scanning)
+   {
+      return;
+   }
+   CS_info.scanning = true;
+
+   // RE-ARM THE DMA CHANNEL FOR ONE FRAME
+   myDMACTRL0_descriptors[CS_DMA_CHANNEL].control = CS_DMA_CONTROL;
+   SI32_DMACTRL_A_enable_channel(SI32_DMACTRL_0, CS_DMA_CHANNEL);
+
+   // START ONE SCAN OF ALL SCANM CHANNELS
+   SI32_CAPSENSE_A_enable_module(SI32_CAPSENSE_0);
+   SI32_CAPSENSE_A_start_manual_conversion(SI32_CAPSENSE_0);
+}
+#else
 void scan_slider(void)
 {
    // RESET CHANNEL POINTER
@@ -87,43 +165,48 @@ void scan_slider(void)
    SI32_CAPSENSE_A_enable_module(SI32_CAPSENSE_0);
    SI32_CAPSENSE_A_start_manual_conversion(SI32_CAPSENSE_0);
 }
+#endif
 
 //------------------------------------------------------------------------------
-void calculate_position(uint8_t scale)
+// Interpolates CS_INTERPOLATION_STEPS virtual positions between each pair of
+// neighbouring channels. Position pos = seg * steps + k weighs the channels
+// with (steps - k) and (k + 1), so the code of the next position differs by
+// (top - bot) and needs no division. Only segments with a channel above its
+// threshold are searched. Integer only, this runs in the CAPSENSE interrupt.
+void calculate_position(void)
 {
-  uint32_t samples = sizeof(CS_info.readings) / 4;
   uint32_t maxVal = 0;
   uint32_t maxPos = 0xFF;
-  uint32_t pos;
-  uint32_t range = (samples - 1)*scale;
-  uint32_t top, bot, tscale, bscale;
+  uint32_t pos = 0;
+  uint32_t seg, k;
+  uint32_t bot, top, touched;
   uint32_t sum;
 
-  // For each virtual position
-  for (pos=0; pos<range; pos++)
+  // For each segment between two channels
+  for (seg=0; seg<CS_CHANNELS - 1; seg++, pos += CS_INTERPOLATION_STEPS)
   {
-    // Calculate positions and interpolation fraction
-    bot = pos/scale;
-    top = bot + 1;
-    tscale = (pos % scale) + 1;
-    bscale = scale - (pos % scale);
-
-    // Calculate code for interpolated virtual position
-    sum = (CS_info.readings[bot] - CS_info.baseline[bot]) * bscale
-        + (CS_info.readings[top] - CS_info.baseline[top]) * tscale;
+    touched = (CS_info.readings[seg] > CS_info.threshold[seg])
+           || (CS_info.readings[seg + 1] > CS_info.threshold[seg + 1]);
+    if (!touched)
+    {
+      continue;
+    }
 
+    // Code of the first virtual position in the segment
+    bot = CS_info.readings[seg] - CS_info.baseline[seg];
+    top = CS_info.readings[seg + 1] - CS_info.baseline[seg + 1];
+    sum = bot * CS_INTERPOLATION_STEPS + top;
 
     // update touch if this is the highest code measured
-    // and it is high enough above baseline
-    if ((sum > maxVal)
-        && (CS_info.readings[bot] >  ((CS_info.baseline[bot] + 0x100) * 1.20)
-            || CS_info.readings[top] >  ((CS_info.baseline[top] + 0x100) * 1.20)))
+    for (k=0; k<CS_INTERPOLATION_STEPS; k++, sum += top - bot)
     {
-      maxVal = sum;
-      maxPos = pos;
+      if (sum > maxVal)
+      {
+        maxVal = sum;
+        maxPos = pos + k;
+      }
     }
-
-  }// foreach virtual positon
+  }// foreach segment
 
   // IF VALID TOUCH SENSED
   if (maxPos <0x80)
@@ -150,6 +233,11 @@ void calibrate_capsense(void)
    //DISABLE INTERUPTS
    NVIC_DisableIRQ(CAPSENSE0_IRQn);
 
+   //COUNT CYCLES FOR CapsenseWorstCycles
+   CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+   DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+   CapsenseWorstCycles = 0;
+
    //INIT MANUAL SCAN STRUCTURE
    CS_info.chan = 0;
    CS_info.channels[0] = 0x0;
@@ -174,8 +262,31 @@ void calibrate_capsense(void)
 
        //SET INITIAL BASELINE TO MEASURED - 0x100 MARGIN
        CS_info.baseline[i] = SI32_CAPSENSE_A_read_data(SI32_CAPSENSE_0) - 0x100;
+
+       //TOUCH THRESHOLD, 20% ABOVE MEASURED
+       CS_info.threshold[i] = ((CS_info.baseline[i] + 0x100) * 6) / 5;
    }
 
+#if CS_AUTO_SCAN
+   //SWITCH TO AUTO-SCAN: A START CONVERTS EVERY SCANM CHANNEL AND EACH
+   //RESULT REQUESTS A DMA TRANSFER INSTEAD OF AN INTERRUPT
+   SI32_CAPSENSE_A_disable_conversion_done_interrupt(SI32_CAPSENSE_0);
+   SI32_CAPSENSE_A_write_scanm(SI32_CAPSENSE_0, CS_SCAN_MASK);
+   SI32_CAPSENSE_A_select_single_scan_mode(SI32_CAPSENSE_0);
+   SI32_CAPSENSE_A_enable_dma_requests(SI32_CAPSENSE_0);
+
+   //DMA FROM THE DATA REGISTER INTO THE READINGS
+   myDMACTRL0_init();
+   myDMACTRL0_descriptors[CS_DMA_CHANNEL].src_end = &SI32_CAPSENSE_0->DATA;
+   myDMACTRL0_descriptors[CS_DMA_CHANNEL].dst_end = &CS_info.readings[CS_CHANNELS - 1];
+   SI32_DMAXBAR_A_select_channel_peripheral(SI32_DMAXBAR_0, SI32_DMAXBAR_CHAN0_CAPSENSE0);
+   SI32_DMACTRL_A_enable_data_request(SI32_DMACTRL_0, CS_DMA_CHANNEL);
+   CS_info.scanning = false;
+
+   NVIC_ClearPendingIRQ(CS_DMA_IRQn);
+   NVIC_EnableIRQ(CS_DMA_IRQn);
+#endif
+
    //ENABLE INTERRUPTS
    NVIC_ClearPendingIRQ(CAPSENSE0_IRQn);
    NVIC_EnableIRQ(CAPSENSE0_IRQn);
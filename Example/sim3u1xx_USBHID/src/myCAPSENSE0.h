@@ -15,9 +15,30 @@
 // INCLUDE GENERATED CONTENT
 #include "gCAPSENSE0.h"
 
-
-// Starts a scan of the slider. This results in multiple convert complete
-// interrupts. When the scan is complete the touch position is calculated
+// Virtual positions interpolated between two slider channels. The position
+// range is 5 * CS_INTERPOLATION_STEPS; main() uses it as a key index and an
+// LED shift, so keep it at 10 or below unless those change too.
+#ifndef CS_INTERPOLATION_STEPS
+#define CS_INTERPOLATION_STEPS 2
+#endif
+
+// 1: a scan is one CAPSENSE auto-scan of all slider channels, DMA collects
+// the readings and there is one interrupt per frame.
+// 0: one manual conversion and one interrupt per channel.
+#ifndef CS_AUTO_SCAN
+#define CS_AUTO_SCAN 1
+#endif
+
+// Milliseconds between slider scans
+#if CS_AUTO_SCAN
+#define CS_SCAN_PERIOD_MS 5
+#else
+#define CS_SCAN_PERIOD_MS 100
+#endif
+
+
+// Starts a scan of the slider. When the scan is complete the touch position
+// is calculated. Does nothing while an auto-scan is still running.
 void scan_slider(void);
 
 // Perform initial capsense baselining
@@ -33,6 +54,10 @@ extern uint8_t CapsenseTouchPos;
 //0 if no touch seen durring last poll, else 1
 extern bool CapsenseTouch;
 
+//longest convert complete interrupt seen since calibration, in core clocks
+//(DWT cycle counter). Read it with the debugger.
+extern volatile uint32_t CapsenseWorstCycles;
+
 #endif //__MYCAPSENSE_H__
 
 //-eof--------------------------------------------------------------------------
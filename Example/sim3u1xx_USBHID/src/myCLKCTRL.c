@@ -1,3 +1,252 @@
 // Copyright (c) 2012
 
+#include <si32_device.h>
+#include <SI32_CLKCTRL_A_Type.h>
+#include <SI32_FLASHCTRL_A_Type.h>
+#include <SI32_PLL_A_Type.h>
 #include "myCLKCTRL.h"
+#include "myCpu.h"
+
+enum // AHB clock sources
+{
+  MYCLK_SOURCE_LPOSC,
+  MYCLK_SOURCE_USBOSC,
+  MYCLK_SOURCE_PLL
+};
+
+typedef struct myClkProfileStruct
+{
+  uint32_t ahb_hz;
+  uint8_t  source;
+  uint8_t  apb_div;       // APB = AHB / apb_div, 1, 2 or 4
+  uint8_t  flash_mode;    // flash speed mode (read wait states) for ahb_hz
+} myClkProfileType;
+
+static const myClkProfileType s_Profiles[MYCLK_PROFILE_MAX] =
+{
+  { 20000000, MYCLK_SOURCE_LPOSC,  1, 0 },
+  { 48000000, MYCLK_SOURCE_USBOSC, 2, 1 },
+  { 80000000, MYCLK_SOURCE_PLL,    4, 2 },
+};
+
+// PLL0 reference: the low power oscillator divided to 2.5 MHz.
+// Output = reference * (N + 1) / (M + 1)
+#define PLL_REFERENCE_HZ  2500000
+#define PLL_N             ((80000000 / PLL_REFERENCE_HZ) - 1)
+#define PLL_M             0
+
+static uint32_t s_Profile = MYCLK_PROFILE_LPOSC_20MHZ;
+static volatile uint32_t s_Requested = MYCLK_PROFILE_MAX;
+
+static void clock_task(void);
+mySchedTaskType myCLKCTRL_task = MYSCHED_TASK(clock_task, 0);
+
+//------------------------------------------------------------------------------
+static void pll_start(void)
+{
+  SI32_CLKCTRL_A_enable_apb_to_modules_0(SI32_CLKCTRL_0,
+                                         SI32_CLKCTRL_A_APBCLKG0_PLL0);
+  SI32_PLL_A_select_reference_clock_source_lp0oscdiv(SI32_PLL_0);
+  SI32_PLL_A_set_numerator(SI32_PLL_0, PLL_N);
+  SI32_PLL_A_set_denominator(SI32_PLL_0, PLL_M);
+  SI32_PLL_A_select_dco_frequency_lock_mode(SI32_PLL_0);
+  while (!SI32_PLL_A_is_locked(SI32_PLL_0));
+}
+
+//------------------------------------------------------------------------------
+static void pll_stop(void)
+{
+  SI32_PLL_A_select_disable_dco_output(SI32_PLL_0);
+  SI32_CLKCTRL_A_disable_apb_to_modules_0(SI32_CLKCTRL_0,
+                                          SI32_CLKCTRL_A_APBCLKG0_PLL0);
+}
+
+//------------------------------------------------------------------------------
+static void select_apb_divider(uint32_t div)
+{
+  switch (div)
+  {
+  case 1:
+    SI32_CLKCTRL_A_select_apb_divider(SI32_CLKCTRL_0, SI32_CLKCTRL_A_CONTROL_APBDIV_DIV1_VALUE);
+    break;
+  case 2:
+    SI32_CLKCTRL_A_select_apb_divider(SI32_CLKCTRL_0, SI32_CLKCTRL_A_CONTROL_APBDIV_DIV2_VALUE);
+    break;
+  default:
+    SI32_CLKCTRL_A_select_apb_divider(SI32_CLKCTRL_0, SI32_CLKCTRL_A_CONTROL_APBDIV_DIV4_VALUE);
+    break;
+  }
+}
+
+//------------------------------------------------------------------------------
+static void select_ahb_source(uint32_t source)
+{
+  switch (source)
+  {
+  case MYCLK_SOURCE_USBOSC:
+    SI32_CLKCTRL_A_select_ahb_source_usb0_oscillator(SI32_CLKCTRL_0);
+    break;
+  case MYCLK_SOURCE_PLL:
+    SI32_CLKCTRL_A_select_ahb_source_pll(SI32_CLKCTRL_0);
+    break;
+  default:
+    SI32_CLKCTRL_A_select_ahb_source_low_power_oscillator(SI32_CLKCTRL_0);
+    break;
+  }
+  SI32_CLKCTRL_A_select_ahb_divider(SI32_CLKCTRL_0, SI32_CLKCTRL_A_CONTROL_AHBDIV_DIV1_VALUE);
+}
+
+//------------------------------------------------------------------------------
+// While the clock changes, the flash wait states and the APB divider are the
+// larger of the two profiles, so neither is ever run too fast.
+void myCLKCTRL_set_profile(uint32_t profile)
+{
+  const myClkProfileType * from = &s_Profiles[s_Profile];
+  const myClkProfileType * to;
+  uint32_t primask;
+
+  if (profile >= MYCLK_PROFILE_MAX || profile == s_Profile)
+  {
+    return;
+  }
+  to = &s_Profiles[profile];
+
+  // Lock the PLL before the switch, the rest runs with interrupts off
+  if (to->source == MYCLK_SOURCE_PLL)
+  {
+    pll_start();
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  if (to->flash_mode > from->flash_mode)
+  {
+    SI32_FLASHCTRL_A_select_flash_speed_mode(SI32_FLASHCTRL_0, to->flash_mode);
+  }
+  if (to->apb_div > from->apb_div)
+  {
+    select_apb_divider(to->apb_div);
+  }
+
+  select_ahb_source(to->source);
+
+  if (to->apb_div < from->apb_div)
+  {
+    select_apb_divider(to->apb_div);
+  }
+  if (to->flash_mode < from->flash_mode)
+  {
+    SI32_FLASHCTRL_A_select_flash_speed_mode(SI32_FLASHCTRL_0, to->flash_mode);
+  }
+
+  s_Profile = profile;
+  SystemCoreClock = to->ahb_hz;
+  // SysTick and the ITM divider
+  cpu_update();
+
+  __set_PRIMASK(primask);
+
+  if (from->source == MYCLK_SOURCE_PLL)
+  {
+    pll_stop();
+  }
+}
+
+//------------------------------------------------------------------------------
+bool myCLKCTRL_request_profile(uint32_t profile)
+{
+  if (profile >= MYCLK_PROFILE_MAX)
+  {
+    return false;
+  }
+  s_Requested = profile;
+  mySched_post(&myCLKCTRL_task);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+static void clock_task(void)
+{
+  myCLKCTRL_set_profile(s_Requested);
+}
+
+//------------------------------------------------------------------------------
+uint32_t myCLKCTRL_get_profile(void)
+{
+  return s_Profile;
+}
+
+//------------------------------------------------------------------------------
+uint32_t myCLKCTRL_get_apb_clock(void)
+{
+  return SystemCoreClock / s_Profiles[s_Profile].apb_div;
+}
+
+#ifdef MYCLK_BENCHMARK
+//==============================================================================
+// Benchmark
+//==============================================================================
+
+#define BENCHMARK_WORDS 256
+#define BENCHMARK_MS    50
+
+myClkBenchmarkType myCLKCTRL_benchmark_results[MYCLK_PROFILE_MAX];
+
+static uint32_t s_BenchmarkData[BENCHMARK_WORDS];
+static volatile uint32_t s_BenchmarkSum;
+
+//------------------------------------------------------------------------------
+// Copy and checksum 1 KB in SRAM, the kind of work an SRAM image does
+static void benchmark_run(void)
+{
+  static uint32_t copy[BENCHMARK_WORDS];
+  uint32_t i, sum = 0;
+
+  for (i = 0; i < BENCHMARK_WORDS; i++)
+  {
+    copy[i] = s_BenchmarkData[i];
+    sum = (sum << 5) + sum + copy[i];
+  }
+  s_BenchmarkSum = sum;
+}
+
+//------------------------------------------------------------------------------
+// Needs SysTick running: the wall time comes from msTicks, so it holds
+// only if the profile's clock is what the table says.
+void myCLKCTRL_benchmark(void)
+{
+  uint32_t profile, start, runs, cycles, i;
+  uint32_t restore = s_Profile;
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  for (i = 0; i < BENCHMARK_WORDS; i++)
+  {
+    s_BenchmarkData[i] = i * 0x9E3779B9;
+  }
+
+  for (profile = 0; profile < MYCLK_PROFILE_MAX; profile++)
+  {
+    myCLKCTRL_set_profile(profile);
+
+    cycles = DWT->CYCCNT;
+    benchmark_run();
+    myCLKCTRL_benchmark_results[profile].cycles = DWT->CYCCNT - cycles;
+
+    // Count the runs in BENCHMARK_MS, from a tick edge
+    start = msTicks;
+    while (msTicks == start);
+    start = msTicks;
+    for (runs = 0; msTicks - start < BENCHMARK_MS; runs++)
+    {
+      benchmark_run();
+    }
+    myCLKCTRL_benchmark_results[profile].ahb_hz = SystemCoreClock;
+    myCLKCTRL_benchmark_results[profile].runs_per_s = runs * (1000 / BENCHMARK_MS);
+  }
+
+  myCLKCTRL_set_profile(restore);
+}
+#endif
@@ -1,9 +1,66 @@
 // Copyright (c) 2012
 
+//------------------------------------------------------------------------------
+// Clock profiles
+//------------------------------------------------------------------------------
+// A profile sets the AHB clock source and divider, the APB divider and the
+// flash speed mode that go together. Switching also updates SystemCoreClock,
+// SysTick and the ITM divider (cpu_update). The USB module keeps running
+// from its own 48 MHz oscillator whatever the profile.
+//
+// The APB dividers keep the APB clock at 20-24 MHz in every profile, so the
+// CAPSENSE conversions stay close to what calibrate_capsense() measured.
+//------------------------------------------------------------------------------
+
 #ifndef __MYCLKCTRL_H__
 #define __MYCLKCTRL_H__
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "gCLKCTRL.h"
+#include "myScheduler.h"
+
+enum // Profiles
+{
+  MYCLK_PROFILE_LPOSC_20MHZ = 0, // reset clock, low power oscillator
+  MYCLK_PROFILE_USBOSC_48MHZ,    // USB oscillator, APB 24 MHz
+  MYCLK_PROFILE_PLL_80MHZ,       // PLL0, APB 20 MHz
+  MYCLK_PROFILE_MAX
+};
+
+// Profile entered by main(), build with -DMYCLK_STARTUP_PROFILE=0 to stay
+// at the reset clock
+#ifndef MYCLK_STARTUP_PROFILE
+#define MYCLK_STARTUP_PROFILE MYCLK_PROFILE_PLL_80MHZ
+#endif
+
+// Switches to a profile now. Not for interrupt handlers.
+void myCLKCTRL_set_profile(uint32_t profile);
+
+// Switches from myCLKCTRL_task, safe from interrupt handlers. Returns false
+// for a profile that does not exist.
+bool myCLKCTRL_request_profile(uint32_t profile);
+
+uint32_t myCLKCTRL_get_profile(void);
+
+// APB clock in Hz, the timer clock of TIMER0/1
+uint32_t myCLKCTRL_get_apb_clock(void);
+
+// Applies myCLKCTRL_request_profile, add it to the scheduler
+extern mySchedTaskType myCLKCTRL_task;
+
+#ifdef MYCLK_BENCHMARK
+// Runs the same SRAM workload at every profile, see myCLKCTRL_benchmark_results
+void myCLKCTRL_benchmark(void);
+
+typedef struct myClkBenchmarkStruct
+{
+  uint32_t ahb_hz;
+  uint32_t cycles;        // core cycles per run of the workload
+  uint32_t runs_per_s;    // runs in wall time, from msTicks
+} myClkBenchmarkType;
 
+extern myClkBenchmarkType myCLKCTRL_benchmark_results[MYCLK_PROFILE_MAX];
+#endif
 
 #endif //__MYCLKCTRL_H__
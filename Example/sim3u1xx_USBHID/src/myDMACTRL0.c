@@ -0,0 +1,36 @@
+//------------------------------------------------------------------------------
+// DMA controller (DMACTRL0) channel control table
+//------------------------------------------------------------------------------
+// hal
+#include <si32_device.h>
+#include <SI32_CLKCTRL_A_Type.h>
+#include <SI32_DMACTRL_A_Type.h>
+// application
+#include "myDMACTRL0.h"
+
+// The controller needs the table aligned to its size
+myDMACTRL0_descriptor_type myDMACTRL0_descriptors[DMA_CHANNELS]
+  __attribute__ ((aligned (DMA_CHANNELS * 16)));
+
+//------------------------------------------------------------------------------
+void myDMACTRL0_init(void)
+{
+   static bool initialized = false;
+
+   if (initialized)
+   {
+      return;
+   }
+   initialized = true;
+
+   // ENABLE DMA CONTROLLER AND CROSSBAR CLOCKS
+   SI32_CLKCTRL_A_enable_ahb_to_dma_controller(SI32_CLKCTRL_0);
+   SI32_CLKCTRL_A_enable_apb_to_modules_0(SI32_CLKCTRL_0,
+                                          SI32_CLKCTRL_A_APBCLKG0_DMAXBAR0);
+
+   // POINT THE CONTROLLER AT THE CHANNEL TABLE
+   SI32_DMACTRL_A_write_baseptr(SI32_DMACTRL_0, (uint32_t) myDMACTRL0_descriptors);
+   SI32_DMACTRL_A_enable_module(SI32_DMACTRL_0);
+}
+
+//-eof--------------------------------------------------------------------------
@@ -0,0 +1,41 @@
+//------------------------------------------------------------------------------
+// DMA controller (DMACTRL0) channel control table
+//------------------------------------------------------------------------------
+
+#ifndef __MYDMACTRL0_H__
+#define __MYDMACTRL0_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DMA_CHANNELS 16
+
+// Channel control structure, as the controller (ARM PL230) reads it
+typedef struct myDMACTRL0_descriptor_struct
+{
+  volatile void *   src_end;    // address of the last source item
+  volatile void *   dst_end;    // address of the last destination item
+  volatile uint32_t control;
+  uint32_t          unused;
+} myDMACTRL0_descriptor_type;
+
+// Control word fields. The controller counts N_MINUS_1 down and clears
+// CYCLE when a cycle completes, so the word is rewritten for every cycle.
+#define DMA_CONTROL_DST_INC_WORD   (2u << 30)
+#define DMA_CONTROL_DST_SIZE_WORD  (2u << 28)
+#define DMA_CONTROL_SRC_INC_NONE   (3u << 26)
+#define DMA_CONTROL_SRC_SIZE_WORD  (2u << 24)
+#define DMA_CONTROL_R_POWER(n)     ((uint32_t)(n) << 14)
+#define DMA_CONTROL_N_MINUS_1(n)   ((uint32_t)(n) << 4)
+#define DMA_CONTROL_CYCLE_BASIC    (1u)
+
+// Primary control structures of all channels
+extern myDMACTRL0_descriptor_type myDMACTRL0_descriptors[DMA_CHANNELS];
+
+// Clocks the controller and points it at myDMACTRL0_descriptors. Modules
+// using DMA call it, only the first call does anything.
+void myDMACTRL0_init(void);
+
+#endif //__MYDMACTRL0_H__
+
+//-eof--------------------------------------------------------------------------
@@ -0,0 +1,231 @@
+//------------------------------------------------------------------------------
+// Cooperative scheduler with a timer queue and tickless idle
+//------------------------------------------------------------------------------
+// The time base is msTicks, counted by SysTick. When the next deadline is
+// more than a millisecond away the idle loop stretches the SysTick period
+// up to it, so the core sleeps through the ticks in between, and adds the
+// skipped milliseconds to msTicks when it wakes up.
+//------------------------------------------------------------------------------
+// hal
+#include <si32_device.h>
+// application
+#include "myCpu.h"
+#include "myScheduler.h"
+
+// Signed distance between two msTicks values, safe across wrap-around
+#define TICKS_BEFORE(a, b)  ((int32_t)((a) - (b)) < 0)
+
+static mySchedTaskType * s_Tasks;
+static mySchedTaskType * s_Timed;
+static volatile bool s_Posted;
+
+volatile uint32_t mySched_busy_cycles;
+
+//==============================================================================
+// Timer Queue
+//==============================================================================
+
+//------------------------------------------------------------------------------
+static void timer_insert(mySchedTaskType * task)
+{
+  mySchedTaskType ** link = &s_Timed;
+
+  // Behind the tasks with the same deadline, so equal periods alternate
+  while (*link && !TICKS_BEFORE(task->deadline, (*link)->deadline))
+  {
+    link = &(*link)->next_timed;
+  }
+  task->next_timed = *link;
+  *link = task;
+  task->timed = true;
+}
+
+//------------------------------------------------------------------------------
+void mySched_stop(mySchedTaskType * task)
+{
+  mySchedTaskType ** link = &s_Timed;
+
+  while (*link && *link != task)
+  {
+    link = &(*link)->next_timed;
+  }
+  if (*link)
+  {
+    *link = task->next_timed;
+  }
+  task->timed = false;
+}
+
+//------------------------------------------------------------------------------
+void mySched_start(mySchedTaskType * task, uint32_t delay_ms)
+{
+  if (task->timed)
+  {
+    mySched_stop(task);
+  }
+  task->deadline = msTicks + delay_ms;
+  timer_insert(task);
+}
+
+//==============================================================================
+// Tasks
+//==============================================================================
+
+//------------------------------------------------------------------------------
+void mySched_add(mySchedTaskType * task)
+{
+  task->next_task = s_Tasks;
+  s_Tasks = task;
+}
+
+//------------------------------------------------------------------------------
+void mySched_post(mySchedTaskType * task)
+{
+  task->posted = true;
+  s_Posted = true;
+}
+
+//------------------------------------------------------------------------------
+static void run_task(mySchedTaskType * task, uint32_t late_ms)
+{
+  uint32_t start = DWT->CYCCNT;
+  uint32_t cycles;
+
+  task->run();
+
+  cycles = DWT->CYCCNT - start;
+  mySched_busy_cycles += cycles;
+  task->runs++;
+  if (cycles > task->worst_cycles)
+  {
+    task->worst_cycles = cycles;
+  }
+  if (late_ms > task->worst_late_ms)
+  {
+    task->worst_late_ms = late_ms;
+  }
+}
+
+//==============================================================================
+// Idle
+//==============================================================================
+
+//------------------------------------------------------------------------------
+// Sleeps up to ms milliseconds or until an interrupt. Called with interrupts
+// masked: WFI still wakes on a pending interrupt, which then runs once they
+// are unmasked.
+static void idle(uint32_t ms)
+{
+  uint32_t per_ms = SystemCoreClock / 1000;
+  uint32_t max_ms = (SysTick_LOAD_RELOAD_Msk + 1) / per_ms;
+  uint32_t ctrl, load, before, elapsed;
+
+  if (ms > max_ms)
+  {
+    ms = max_ms;
+  }
+  if (ms <= 1)
+  {
+    // The next tick is the deadline
+    __WFI();
+    return;
+  }
+
+  // Stretch the current tick by ms - 1 whole ticks
+  SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+  before = per_ms - 1 - SysTick->VAL;
+  load = ms * per_ms - 1 - before;
+  SysTick->LOAD = load;
+  SysTick->VAL = 0;
+  SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+
+  __WFI();
+
+  // Reading CTRL clears COUNTFLAG, so read it once
+  ctrl = SysTick->CTRL;
+  SysTick->CTRL = ctrl & ~SysTick_CTRL_ENABLE_Msk;
+  if (ctrl & SysTick_CTRL_COUNTFLAG_Msk)
+  {
+    // The long tick ran out, its pending interrupt counts the last ms
+    msTicks += ms - 1;
+    SysTick->LOAD = per_ms - 1;
+  }
+  else
+  {
+    // Woken early: count the whole ms that passed and finish the current
+    // one with a short tick
+    elapsed = before + load - SysTick->VAL;
+    msTicks += elapsed / per_ms;
+    SysTick->LOAD = per_ms - 1 - (elapsed % per_ms);
+  }
+  SysTick->VAL = 0;
+  SysTick->CTRL = (ctrl & ~SysTick_CTRL_COUNTFLAG_Msk) | SysTick_CTRL_ENABLE_Msk;
+  // Takes effect from the next reload on
+  SysTick->LOAD = per_ms - 1;
+}
+
+//------------------------------------------------------------------------------
+void mySched_run(void)
+{
+  mySchedTaskType * task;
+  uint32_t now, late;
+
+  // DWT CYCLE COUNTER FOR THE TASK STATISTICS
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  while (1)
+  {
+    // RUN THE TASKS WHOSE DEADLINE HAS COME
+    now = msTicks;
+    while (s_Timed && !TICKS_BEFORE(now, s_Timed->deadline))
+    {
+      task = s_Timed;
+      s_Timed = task->next_timed;
+      task->timed = false;
+      late = now - task->deadline;
+      if (task->period)
+      {
+        // Next period, skipping the ones that were missed
+        task->deadline += task->period;
+        while (!TICKS_BEFORE(now, task->deadline))
+        {
+          task->deadline += task->period;
+        }
+        timer_insert(task);
+      }
+      run_task(task, late);
+    }
+
+    // RUN THE POSTED TASKS
+    if (s_Posted)
+    {
+      s_Posted = false;
+      for (task = s_Tasks; task; task = task->next_task)
+      {
+        if (task->posted)
+        {
+          task->posted = false;
+          run_task(task, 0);
+        }
+      }
+    }
+
+    // SLEEP UNTIL THE NEXT DEADLINE OR INTERRUPT
+    __disable_irq();
+    if (!s_Posted)
+    {
+      if (!s_Timed)
+      {
+        idle(0xFFFFFFFF);
+      }
+      else if (TICKS_BEFORE(msTicks, s_Timed->deadline))
+      {
+        idle(s_Timed->deadline - msTicks);
+      }
+    }
+    __enable_irq();
+  }
+}
+
+//-eof--------------------------------------------------------------------------
@@ -0,0 +1,55 @@
+//------------------------------------------------------------------------------
+// Cooperative scheduler with a timer queue and tickless idle
+//------------------------------------------------------------------------------
+
+#ifndef __MYSCHEDULER_H__
+#define __MYSCHEDULER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A task runs to completion from mySched_run(), never from an interrupt.
+// It runs when its deadline in msTicks is reached (mySched_start) or as soon
+// as possible after mySched_post.
+typedef struct mySchedTask_struct
+{
+  void (*run)(void);
+  uint32_t period;                        // ms between runs, 0 for one-shot
+
+  // Scheduler state
+  uint32_t deadline;                      // msTicks of the next timed run
+  bool timed;                             // in the timer queue
+  volatile bool posted;
+  struct mySchedTask_struct * next_timed; // timer queue, by deadline
+  struct mySchedTask_struct * next_task;  // all tasks
+
+  // Statistics, in DWT cycles and ms
+  uint32_t runs;
+  uint32_t worst_cycles;
+  uint32_t worst_late_ms;
+} mySchedTaskType;
+
+#define MYSCHED_TASK(fn, period_ms)  { (fn), (period_ms) }
+
+// Registers a task. Call before starting or posting it.
+void mySched_add(mySchedTaskType * task);
+
+// Runs the task after delay_ms, and then every period ms if it has one.
+// Restarts a task that is already waiting. Not for interrupt handlers.
+void mySched_start(mySchedTaskType * task, uint32_t delay_ms);
+
+// Takes a task out of the timer queue.
+void mySched_stop(mySchedTaskType * task);
+
+// Runs the task as soon as possible. Safe from interrupt handlers.
+void mySched_post(mySchedTaskType * task);
+
+// Runs the tasks forever, sleeping (WFI) while there is nothing to do.
+void mySched_run(void);
+
+// Cycles spent in tasks. Against msTicks this gives the CPU load.
+extern volatile uint32_t mySched_busy_cycles;
+
+#endif //__MYSCHEDULER_H__
+
+//-eof--------------------------------------------------------------------------
@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// LED brightness PWM on P2.10, timed by TIMER1
+//------------------------------------------------------------------------------
+// TIMER1 runs as one 32-bit up counter from the APB clock. Each overflow
+// switches the LED and loads the counter with the length of the next phase,
+// so the brightness no longer depends on what the main loop is doing and
+// the core can sleep in between.
+//------------------------------------------------------------------------------
+// hal
+#include <si32_device.h>
+#include <SI32_CLKCTRL_A_Type.h>
+#include <SI32_PBSTD_A_Type.h>
+#include <SI32_TIMER_A_Type.h>
+// application
+#include "myCLKCTRL.h"
+#include "myTIMER1.h"
+
+// P2.10 drives the LED, active low
+#define LED_PIN 0x400
+
+// On time in timer clocks, 0 for off
+static volatile uint32_t s_OnTicks;
+static uint8_t s_LedOn;
+
+//------------------------------------------------------------------------------
+static uint32_t period_ticks(void)
+{
+  return myCLKCTRL_get_apb_clock() / LED_PWM_FREQUENCY;
+}
+
+//------------------------------------------------------------------------------
+void myTIMER1_led_pwm_set(uint32_t level)
+{
+  if (level >= LED_PWM_LEVELS)
+  {
+    level = LED_PWM_LEVELS - 1;
+  }
+  s_OnTicks = (period_ticks() / LED_PWM_LEVELS) * level;
+}
+
+//------------------------------------------------------------------------------
+void myTIMER1_led_pwm_start(void)
+{
+  SI32_CLKCTRL_A_enable_apb_to_modules_0(SI32_CLKCTRL_0,
+                                         SI32_CLKCTRL_A_APBCLKG0_TIMER1);
+
+  SI32_PBSTD_A_write_pins_high(SI32_PBSTD_2, LED_PIN);
+  s_LedOn = 0;
+
+  SI32_TIMER_A_select_single_timer_mode(SI32_TIMER_1);
+  SI32_TIMER_A_select_high_clock_source_apb_clock(SI32_TIMER_1);
+  SI32_TIMER_A_write_count(SI32_TIMER_1, 0 - period_ticks());
+  SI32_TIMER_A_enable_high_overflow_interrupt(SI32_TIMER_1);
+
+  NVIC_ClearPendingIRQ(TIMER1H_IRQn);
+  NVIC_EnableIRQ(TIMER1H_IRQn);
+
+  SI32_TIMER_A_start_high_timer(SI32_TIMER_1);
+}
+
+//------------------------------------------------------------------------------
+void TIMER1H_IRQHandler(void)
+{
+  uint32_t period = period_ticks();
+  uint32_t on = s_OnTicks;
+  uint32_t next;
+
+  SI32_TIMER_A_clear_high_overflow_interrupt(SI32_TIMER_1);
+
+  if (!s_LedOn && on)
+  {
+    // TURN ON LED driver (P2.10)
+    SI32_PBSTD_A_write_pins_low(SI32_PBSTD_2, LED_PIN);
+    s_LedOn = 1;
+    next = on;
+  }
+  else
+  {
+    // TURN OFF LED driver (P2.10) for the rest of the period
+    SI32_PBSTD_A_write_pins_high(SI32_PBSTD_2, LED_PIN);
+    next = s_LedOn ? period - on : period;
+    s_LedOn = 0;
+  }
+
+  // Overflow again after next clocks
+  SI32_TIMER_A_write_count(SI32_TIMER_1, 0 - next);
+}
+
+//-eof--------------------------------------------------------------------------
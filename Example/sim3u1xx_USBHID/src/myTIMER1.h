@@ -0,0 +1,23 @@
+//------------------------------------------------------------------------------
+// LED brightness PWM on P2.10, timed by TIMER1
+//------------------------------------------------------------------------------
+
+#ifndef __MYTIMER1_H__
+#define __MYTIMER1_H__
+
+#include <stdint.h>
+
+// PWM frequency, high enough not to flicker
+#define LED_PWM_FREQUENCY 200
+
+// Duty cycle resolution
+#define LED_PWM_LEVELS 1024
+
+void myTIMER1_led_pwm_start(void);
+
+// Sets the LED on time, in 1/LED_PWM_LEVELS of the period
+void myTIMER1_led_pwm_set(uint32_t level);
+
+#endif //__MYTIMER1_H__
+
+//-eof--------------------------------------------------------------------------
@@ -10,6 +10,7 @@
 #include "myUSB0.h"
 #include "si32Usb.h"
 #include "myUsbDevice.h"
+#include "myUsbBulk.h"
 
 #include <SI32_USB_A_Type.h>
 #include <SI32_USBEP_A_Type.h>
@@ -79,7 +80,21 @@ void USB0_ep0_handler(void)
 //------------------------------------------------------------------------------
 void USB0_ep1_in_handler(void)
 {
-  myUSB0_ep1_state = EPN_IDLE;
+  // Refill from the report ring, EP1 goes idle when it is empty
+  if (!myHidSendNextReport())
+    myUSB0_ep1_state = EPN_IDLE;
+}
+
+//------------------------------------------------------------------------------
+void USB0_ep2_in_handler(void)
+{
+  myUsbBulk_in_handler();
+}
+
+//------------------------------------------------------------------------------
+void USB0_ep2_out_handler(void)
+{
+  myUsbBulk_out_handler();
 }
 
 //------------------------------------------------------------------------------
@@ -182,139 +197,222 @@ void USB0_stop()
    myUSB0_ep0_state = EP0_DISABLED;
 }
 
+//==============================================================================
+// FIFO Copy
+//==============================================================================
+// One copy engine for EP0 and EPn. The FIFO is accessed a word at a time
+// whatever the alignment of the buffer: bytes of a misaligned buffer are
+// merged into (or split out of) FIFO words with shifts, using aligned word
+// accesses to RAM only. A tail of 2 or 3 bytes takes a 16-bit access.
+//
+// The helpers are always inlined with ep0 constant, so each public function
+// gets its own copy without a branch per access.
 //------------------------------------------------------------------------------
-uint32_t USB0_EP0_read_fifo(uint8_t * dst,  uint32_t count)
+#define FIFO_INLINE static inline __attribute__ ((always_inline))
+
+FIFO_INLINE uint32_t fifo_read_u32(bool ep0, SI32_USBEP_A_Type *ep)
 {
-  uint32_t * pTmp32;
-  uint32_t result;
-  count = _min( count, SI32_USB_A_read_ep0_count(SI32_USB_0) );
-  result=count;
-  while( (((uint32_t) dst) & 0x3) && count)
-  {
-    *dst++=SI32_USB_A_read_ep0_fifo_u8(SI32_USB_0);
-    count--;
-  };
+  return ep0 ? SI32_USB_A_read_ep0_fifo_u32(SI32_USB_0) : SI32_USBEP_A_read_fifo_u32(ep);
+}
 
-  pTmp32=(uint32_t*) dst;
-  while(count>3)
-  {
-    *pTmp32++=SI32_USB_A_read_ep0_fifo_u32(SI32_USB_0);
-    count-=4;
-  }
-  dst = (uint8_t*) pTmp32;
-  while(count)
-  {
-    *dst++=(uint32_t) SI32_USB_A_read_ep0_fifo_u8(SI32_USB_0);
-    count--;
-  }
-  return result;
+FIFO_INLINE uint32_t fifo_read_u16(bool ep0, SI32_USBEP_A_Type *ep)
+{
+  return ep0 ? SI32_USB_A_read_ep0_fifo_u16(SI32_USB_0) : SI32_USBEP_A_read_fifo_u16(ep);
 }
 
+FIFO_INLINE uint32_t fifo_read_u8(bool ep0, SI32_USBEP_A_Type *ep)
+{
+  return ep0 ? SI32_USB_A_read_ep0_fifo_u8(SI32_USB_0) : SI32_USBEP_A_read_fifo_u8(ep);
+}
+
+FIFO_INLINE void fifo_write_u32(bool ep0, SI32_USBEP_A_Type *ep, uint32_t value)
+{
+  if (ep0)
+    SI32_USB_A_write_ep0_fifo_u32(SI32_USB_0, value);
+  else
+    SI32_USBEP_A_write_fifo_u32(ep, value);
+}
 
+FIFO_INLINE void fifo_write_u16(bool ep0, SI32_USBEP_A_Type *ep, uint32_t value)
+{
+  if (ep0)
+    SI32_USB_A_write_ep0_fifo_u16(SI32_USB_0, value);
+  else
+    SI32_USBEP_A_write_fifo_u16(ep, value);
+}
+
+FIFO_INLINE void fifo_write_u8(bool ep0, SI32_USBEP_A_Type *ep, uint32_t value)
+{
+  if (ep0)
+    SI32_USB_A_write_ep0_fifo_u8(SI32_USB_0, value);
+  else
+    SI32_USBEP_A_write_fifo_u8(ep, value);
+}
 
 //------------------------------------------------------------------------------
-uint32_t USB0_EP0_write_fifo(uint8_t * src, uint32_t count)
+FIFO_INLINE void fifo_read(bool ep0, SI32_USBEP_A_Type *ep, uint8_t * dst, uint32_t count)
 {
+  uint32_t offset = ((uint32_t) dst) & 0x3;
+  uint32_t words = count >> 2;
   uint32_t * pTmp32;
-  uint32_t result;
-  result=count=_min( count, EP0_MAX_PACKET_SIZE);
-
-   // ensure src buffer is 32-bit aligned
-   while( (((uint32_t) src) & 0x3) && count)
-   {
-     SI32_USB_A_write_ep0_fifo_u8(SI32_USB_0, *src);
-     src++;
-     count--;
-   }
+  uint32_t word, carry, shift;
 
-   // use 32-bit fifo writes, now that we know that the src buffer
-   // is aligned.
-   pTmp32=(uint32_t*) src;
-   while( count > 3 )
-   {
-     SI32_USB_A_write_ep0_fifo_u32(SI32_USB_0, *pTmp32);
-     pTmp32++;
-     count-=4;
-   }
-   src = (uint8_t*) pTmp32;
+  if (words && !offset)
+  {
+    pTmp32 = (uint32_t*) dst;
+    while (words--)
+    {
+      *pTmp32++ = fifo_read_u32(ep0, ep);
+    }
+    dst = (uint8_t*) pTmp32;
+  }
+  else if (words)
+  {
+    // The first word fills dst up to a word boundary and leaves offset
+    // bytes in carry. Every next word completes an aligned word of dst.
+    word = fifo_read_u32(ep0, ep);
+    shift = offset << 3;
+    carry = word;
+    while (dst != (uint8_t*) (((uint32_t) dst + 3) & ~0x3))
+    {
+      *dst++ = carry;
+      carry >>= 8;
+    }
+    pTmp32 = (uint32_t*) dst;
+    while (--words)
+    {
+      word = fifo_read_u32(ep0, ep);
+      *pTmp32++ = carry | (word << shift);
+      carry = word >> (32 - shift);
+    }
+    dst = (uint8_t*) pTmp32;
+    while (offset--)
+    {
+      *dst++ = carry;
+      carry >>= 8;
+    }
+  }
 
-   // Write out any residue bytes 1 byte at a time
-   while(count)
-   {
-     SI32_USB_A_write_ep0_fifo_u8(SI32_USB_0, *src);
-     src++;
-     count--;
-   }
-  return result;
+  // Tail of 0 to 3 bytes
+  if (count & 0x2)
+  {
+    word = fifo_read_u16(ep0, ep);
+    *dst++ = word;
+    *dst++ = word >> 8;
+  }
+  if (count & 0x1)
+  {
+    *dst = fifo_read_u8(ep0, ep);
+  }
 }
 
-
 //------------------------------------------------------------------------------
-uint32_t USB0_EPn_read_fifo(SI32_USBEP_A_Type *ep,  uint8_t * dst,  uint32_t count)
+FIFO_INLINE void fifo_write(bool ep0, SI32_USBEP_A_Type *ep, uint8_t * src, uint32_t count)
 {
+  uint32_t offset = ((uint32_t) src) & 0x3;
+  uint32_t words = count >> 2;
   uint32_t * pTmp32;
-  uint32_t result;
-  count = _min( count, SI32_USBEP_A_read_data_count(ep) );
-  result=count;
+  uint32_t word, carry, shift;
 
-  while ( (((uint32_t) dst) & 0x3) && count)
+  if (words && !offset)
+  {
+    pTmp32 = (uint32_t*) src;
+    while (words--)
+    {
+      fifo_write_u32(ep0, ep, *pTmp32++);
+    }
+    src = (uint8_t*) pTmp32;
+  }
+  else if (words)
   {
-    *dst++=SI32_USBEP_A_read_fifo_u8(ep);
-    count--;
-  };
+    // Aligned loads only: each FIFO word is the top of one source word and
+    // the bottom of the next. The bytes of the first and last source words
+    // outside the buffer are loaded but never used.
+    shift = offset << 3;
+    pTmp32 = (uint32_t*) (src - offset);
+    carry = *pTmp32++ >> shift;
+    while (words--)
+    {
+      word = *pTmp32++;
+      fifo_write_u32(ep0, ep, carry | (word << (32 - shift)));
+      carry = word >> shift;
+    }
+    src = (uint8_t*) pTmp32 - 4 + offset;
+  }
 
-  pTmp32=(uint32_t*) dst;
-  while (count>3)
+  // Tail of 0 to 3 bytes
+  if (count & 0x2)
   {
-    *pTmp32++=SI32_USBEP_A_read_fifo_u32(ep);
-    count-=4;
+    fifo_write_u16(ep0, ep, src[0] | (src[1] << 8));
+    src += 2;
   }
-  dst = (uint8_t*) pTmp32;
-  while (count)
+  if (count & 0x1)
   {
-    *dst++=(uint32_t) SI32_USBEP_A_read_fifo_u8(ep);
-    count--;
+    fifo_write_u8(ep0, ep, *src);
   }
-  return result;
 }
 
+//------------------------------------------------------------------------------
+uint32_t USB0_EP0_read_fifo(uint8_t * dst,  uint32_t count)
+{
+  count = _min( count, SI32_USB_A_read_ep0_count(SI32_USB_0) );
+  fifo_read(true, 0, dst, count);
+  return count;
+}
 
+//------------------------------------------------------------------------------
+uint32_t USB0_EP0_write_fifo(uint8_t * src, uint32_t count)
+{
+  count = _min( count, EP0_MAX_PACKET_SIZE);
+  fifo_write(true, 0, src, count);
+  return count;
+}
+
+//------------------------------------------------------------------------------
+uint32_t USB0_EPn_read_fifo(SI32_USBEP_A_Type *ep,  uint8_t * dst,  uint32_t count)
+{
+  count = _min( count, SI32_USBEP_A_read_data_count(ep) );
+  fifo_read(false, ep, dst, count);
+  return count;
+}
 
 //------------------------------------------------------------------------------
 uint32_t USB0_EPn_write_fifo(SI32_USBEP_A_Type *ep, uint8_t * src, uint32_t count)
 {
-  uint32_t * pTmp32;
-  uint32_t result;
-  result=count=_min( count, (SI32_USBEP_A_get_in_max_packet_size(ep)<<3));
+  count = _min( count, (SI32_USBEP_A_get_in_max_packet_size(ep)<<3));
+  fifo_write(false, ep, src, count);
+  return count;
+}
 
-  // ensure src buffer is 32-bit aligned
-  while ( (((uint32_t) src) & 0x3) && count)
-  {
-    SI32_USBEP_A_write_fifo_u8(ep, *src);
-    src++;
-    count--;
-  }
+#ifdef USB0_FIFO_BENCHMARK
+//------------------------------------------------------------------------------
+// DWT cycles to write and to read one 64-byte packet through the EP2 FIFO,
+// for each buffer offset from a word boundary. Run before USB0_connect, the
+// FIFO contents are thrown away.
+uint32_t USB0_fifo_benchmark_cycles[2][4];
 
-  // use 32-bit fifo writes, now that we know that the src buffer
-  // is aligned.
-  pTmp32=(uint32_t*) src;
-  while ( count > 3 )
-  {
-    SI32_USBEP_A_write_fifo_u32(ep, *pTmp32);
-    pTmp32++;
-    count-=4;
-  }
-  src = (uint8_t*) pTmp32;
+void USB0_fifo_benchmark(void)
+{
+  static uint32_t buffer[64 / 4 + 1];
+  SI32_USBEP_A_Type *ep = SI32_USB_0_EP2;
+  uint32_t offset, start;
 
-  // Write out any residue bytes 1 byte at a time
-  while (count)
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  for (offset = 0; offset < 4; offset++)
   {
-    SI32_USBEP_A_write_fifo_u8(ep, *src);
-    src++;
-    count--;
+    start = DWT->CYCCNT;
+    fifo_write(false, ep, (uint8_t *)buffer + offset, 64);
+    USB0_fifo_benchmark_cycles[0][offset] = DWT->CYCCNT - start;
+    SI32_USBEP_A_flush_in_fifo(ep);
+
+    start = DWT->CYCCNT;
+    fifo_read(false, ep, (uint8_t *)buffer + offset, 64);
+    USB0_fifo_benchmark_cycles[1][offset] = DWT->CYCCNT - start;
+    SI32_USBEP_A_flush_out_fifo(ep);
   }
-  return result;
 }
-
+#endif
 
 //-eof--------------------------------------------------------------------------
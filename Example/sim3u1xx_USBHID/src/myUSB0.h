@@ -52,6 +52,8 @@ extern void USB0_reset_handler(void);
 extern void USB0_suspend_handler(void);
 extern void USB0_ep0_handler(void);
 extern void USB0_ep1_in_handler(void);
+extern void USB0_ep2_in_handler(void);
+extern void USB0_ep2_out_handler(void);
 
 extern uint32_t USB0_EP0_read_fifo(uint8_t * dst,  uint32_t count);
 extern uint32_t USB0_EP0_write_fifo(uint8_t * src, uint32_t count);
@@ -61,6 +63,11 @@ extern void USB0_EPn_handler(SI32_USBEP_A_Type * basePointer);
 extern uint32_t USB0_EPn_read_fifo(SI32_USBEP_A_Type *ep,  uint8_t * dst,  uint32_t count);
 extern uint32_t USB0_EPn_write_fifo(SI32_USBEP_A_Type *ep, uint8_t * src, uint32_t count);
 
+#ifdef USB0_FIFO_BENCHMARK
+extern uint32_t USB0_fifo_benchmark_cycles[2][4];
+extern void USB0_fifo_benchmark(void);
+#endif
+
 // State variables
 extern volatile uint32_t myUSB0_sof_count;
 extern volatile uint32_t myUSB0_device_state;
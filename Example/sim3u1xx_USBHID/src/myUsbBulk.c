@@ -0,0 +1,245 @@
+//------------------------------------------------------------------------------
+// Vendor bulk interface: EP2 IN/OUT loopback and throughput self-test
+//------------------------------------------------------------------------------
+// EP2 runs split, IN and OUT each with half of its FIFO, and both halves
+// double buffered, so the host can move a packet while the core copies the
+// next one. All of the functions here run from the USB0 interrupt (the EP0
+// requests included) and need no locking.
+//
+// The packet buffers are word aligned so USB0_EPn_read_fifo and
+// USB0_EPn_write_fifo copy them with 32-bit FIFO accesses only.
+//------------------------------------------------------------------------------
+// hal
+#include <si32_device.h>
+#include <SI32_USB_A_Type.h>
+#include <SI32_USBEP_A_Type.h>
+// application
+#include "myCLKCTRL.h"
+#include "myCpu.h"
+#include "myUSB0.h"
+#include "myUsbBulk.h"
+
+// Packets the FIFO holds per direction
+#define BULK_FIFO_PACKETS   2
+
+// Loopback ring, in packets (power of 2)
+#define BULK_RING_PACKETS   8
+
+#define BULK_EP SI32_USB_0_EP2
+
+static uint32_t s_Ring[BULK_RING_PACKETS][BULK_MAX_PACKET_SIZE / 4];
+static uint8_t  s_RingSize[BULK_RING_PACKETS];
+static uint32_t s_RingHead;
+static uint32_t s_RingTail;
+
+// Source pattern, sink scratch
+static uint32_t s_Pattern[BULK_MAX_PACKET_SIZE / 4];
+static uint32_t s_Scratch[BULK_MAX_PACKET_SIZE / 4];
+
+static bool s_Started;
+static uint32_t s_FirstTick;
+static myUsbBulkStatsType s_Stats;
+
+//------------------------------------------------------------------------------
+static void count_packet(uint32_t * bytes, uint32_t * packets, uint32_t size)
+{
+  if (!s_Started)
+  {
+    s_Started = true;
+    s_FirstTick = msTicks;
+  }
+  *bytes += size;
+  (*packets)++;
+  s_Stats.ms = msTicks - s_FirstTick;
+}
+
+//------------------------------------------------------------------------------
+static void set_mode(uint32_t mode)
+{
+  s_Stats.mode = mode;
+  s_Stats.bytes_in = 0;
+  s_Stats.bytes_out = 0;
+  s_Stats.packets_in = 0;
+  s_Stats.packets_out = 0;
+  s_Stats.ms = 0;
+  s_Stats.bytes_per_s = 0;
+  s_Started = false;
+  s_RingTail = s_RingHead;
+
+  // Start the streams: the interrupts only come once packets move
+  myUsbBulk_out_handler();
+  myUsbBulk_in_handler();
+}
+
+//==============================================================================
+// Endpoint Handlers
+//==============================================================================
+
+//------------------------------------------------------------------------------
+// EP2 OUT: a packet arrived. Takes packets while there is room for them,
+// the rest wait in the FIFO and the host is NAKed until the IN side frees a
+// ring slot.
+void myUsbBulk_out_handler(void)
+{
+  uint32_t size;
+  uint32_t * dst;
+
+  while (SI32_USBEP_A_is_out_packet_ready(BULK_EP))
+  {
+    if (s_Stats.mode == BULK_MODE_LOOPBACK)
+    {
+      if (s_RingHead - s_RingTail >= BULK_RING_PACKETS)
+      {
+        return;
+      }
+      dst = s_Ring[s_RingHead & (BULK_RING_PACKETS - 1)];
+    }
+    else if (s_Stats.mode == BULK_MODE_SINK)
+    {
+      dst = s_Scratch;
+    }
+    else
+    {
+      return;
+    }
+
+    size = USB0_EPn_read_fifo(BULK_EP, (uint8_t *)dst, BULK_MAX_PACKET_SIZE);
+    SI32_USBEP_A_clear_out_packet_ready(BULK_EP);
+    count_packet(&s_Stats.bytes_out, &s_Stats.packets_out, size);
+
+    if (s_Stats.mode == BULK_MODE_LOOPBACK)
+    {
+      s_RingSize[s_RingHead & (BULK_RING_PACKETS - 1)] = size;
+      s_RingHead++;
+      myUsbBulk_in_handler();
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// EP2 IN: a packet was sent, or there may be something new to send. Keeps
+// both FIFO buffers loaded: with double buffering IN packet ready stays set
+// only while both are full.
+void myUsbBulk_in_handler(void)
+{
+  uint32_t slot;
+  uint32_t size;
+  uint32_t loaded;
+  bool freed = false;
+
+  for (loaded = 0; loaded < BULK_FIFO_PACKETS; loaded++)
+  {
+    if (SI32_USBEP_A_is_in_packet_ready(BULK_EP))
+    {
+      break;
+    }
+
+    if (s_Stats.mode == BULK_MODE_SOURCE)
+    {
+      size = USB0_EPn_write_fifo(BULK_EP, (uint8_t *)s_Pattern, BULK_MAX_PACKET_SIZE);
+    }
+    else if (s_Stats.mode == BULK_MODE_LOOPBACK && s_RingTail != s_RingHead)
+    {
+      slot = s_RingTail & (BULK_RING_PACKETS - 1);
+      size = USB0_EPn_write_fifo(BULK_EP, (uint8_t *)s_Ring[slot], s_RingSize[slot]);
+      s_RingTail++;
+      freed = true;
+    }
+    else
+    {
+      break;
+    }
+    SI32_USBEP_A_set_in_packet_ready(BULK_EP);
+    count_packet(&s_Stats.bytes_in, &s_Stats.packets_in, size);
+  }
+
+  // OUT packets held back for a free ring slot
+  if (freed)
+  {
+    myUsbBulk_out_handler();
+  }
+}
+
+//==============================================================================
+// Configuration
+//==============================================================================
+
+//------------------------------------------------------------------------------
+// SET_CONFIGURATION: EP2 IN and OUT, bulk, 64 bytes, double buffered.
+void myUsbBulk_configure(void)
+{
+  uint32_t i;
+
+  for (i = 0; i < BULK_MAX_PACKET_SIZE; i++)
+  {
+    ((uint8_t *)s_Pattern)[i] = i;
+  }
+
+  SI32_USBEP_A_enable_split_mode(BULK_EP);
+
+  SI32_USBEP_A_clear_in_data_underrun(BULK_EP);
+  SI32_USBEP_A_select_in_bulk_interrupt_mode(BULK_EP);
+  SI32_USBEP_A_stop_in_stall(BULK_EP);
+  SI32_USBEP_A_reset_in_data_toggle(BULK_EP);
+  SI32_USBEP_A_set_in_max_packet_size(BULK_EP, BULK_MAX_PACKET_SIZE>>3);
+  SI32_USBEP_A_enable_in_double_buffer(BULK_EP);
+  SI32_USBEP_A_flush_in_fifo(BULK_EP);
+
+  SI32_USBEP_A_select_out_bulk_interrupt_mode(BULK_EP);
+  SI32_USBEP_A_stop_out_stall(BULK_EP);
+  SI32_USBEP_A_reset_out_data_toggle(BULK_EP);
+  SI32_USBEP_A_set_out_max_packet_size(BULK_EP, BULK_MAX_PACKET_SIZE>>3);
+  SI32_USBEP_A_enable_out_double_buffer(BULK_EP);
+  SI32_USBEP_A_flush_out_fifo(BULK_EP);
+
+  SI32_USB_A_enable_ep2(SI32_USB_0);
+  SI32_USB_A_enable_ep2_in_interrupt(SI32_USB_0);
+  SI32_USB_A_enable_ep2_out_interrupt(SI32_USB_0);
+
+  set_mode(BULK_MODE_IDLE);
+}
+
+//------------------------------------------------------------------------------
+// Vendor requests, returns false for the ones that are not ours.
+bool myUsbBulk_request_handler(void)
+{
+  if (myUSB0_setup.Type != USB_REQUEST_TYPE_VENDOR)
+  {
+    return false;
+  }
+
+  switch (myUSB0_setup.bRequest)
+  {
+  case BULK_REQUEST_SET_MODE:
+    if (myUSB0_setup.wValue >= BULK_MODE_MAX)
+    {
+      myUSB0_ep0_state = EP0_SEND_STALL;
+      break;
+    }
+    set_mode(myUSB0_setup.wValue);
+    myUSB0_ep0_state = EP0_NODATA_STATUS;
+    break;
+
+  case BULK_REQUEST_GET_STATS:
+    s_Stats.bytes_per_s = s_Stats.ms ?
+      (uint32_t)(((uint64_t)s_Stats.bytes_in + s_Stats.bytes_out) * 1000 / s_Stats.ms) : 0;
+    s_Stats.ahb_hz = SystemCoreClock;
+    myUSB0_ep0_data_pointer = (uint8_t *)&s_Stats;
+    myUSB0_ep0_data_size    = _min(myUSB0_setup.wLength, sizeof(s_Stats));
+    myUSB0_ep0_state        = EP0_START_IN_DATA;
+    break;
+
+  case BULK_REQUEST_SET_CLOCK:
+    // Switched by myCLKCTRL_task once the request is done
+    myUSB0_ep0_state = myCLKCTRL_request_profile(myUSB0_setup.wValue) ?
+                       EP0_NODATA_STATUS : EP0_SEND_STALL;
+    break;
+
+  default:
+    myUSB0_ep0_state = EP0_SEND_STALL;
+    break;
+  }
+  return true;
+}
+
+//-eof--------------------------------------------------------------------------
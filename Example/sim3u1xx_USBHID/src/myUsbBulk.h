@@ -0,0 +1,55 @@
+//------------------------------------------------------------------------------
+// Vendor bulk interface: EP2 IN/OUT loopback and throughput self-test
+//------------------------------------------------------------------------------
+
+#ifndef __MYUSBBULK_H__
+#define __MYUSBBULK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Interface and endpoints
+#define BULK_INTERFACE        1
+#define BULK_EP_IN            0x82
+#define BULK_EP_OUT           0x02
+#define BULK_MAX_PACKET_SIZE  64
+
+// Vendor requests to the device
+// SET_MODE (OUT, no data): wValue is the mode, the counters restart
+// GET_STATS (IN): myUsbBulkStatsType
+// SET_CLOCK (OUT, no data): wValue is the clock profile (myCLKCTRL.h)
+#define BULK_REQUEST_SET_MODE   0x01
+#define BULK_REQUEST_GET_STATS  0x02
+#define BULK_REQUEST_SET_CLOCK  0x03
+
+enum // For the test mode
+{
+  BULK_MODE_IDLE = 0,   // OUT packets are refused (NAK), nothing is sent
+  BULK_MODE_LOOPBACK,   // every OUT packet is sent back on IN
+  BULK_MODE_SOURCE,     // IN packets are sent as fast as the host reads them
+  BULK_MODE_SINK,       // OUT packets are read and dropped
+  BULK_MODE_MAX
+};
+
+// Counters since the last SET_MODE. The time runs from the first packet to
+// the last one in either direction.
+typedef struct myUsbBulkStatsStruct
+{
+  uint32_t mode;
+  uint32_t bytes_in;      // device to host
+  uint32_t bytes_out;     // host to device
+  uint32_t packets_in;
+  uint32_t packets_out;
+  uint32_t ms;
+  uint32_t bytes_per_s;   // (bytes_in + bytes_out) over ms
+  uint32_t ahb_hz;        // core clock when the stats were read
+} myUsbBulkStatsType;
+
+extern void myUsbBulk_configure(void);
+extern bool myUsbBulk_request_handler(void);
+extern void myUsbBulk_in_handler(void);
+extern void myUsbBulk_out_handler(void);
+
+#endif //__MYUSBBULK_H__
+
+//-eof--------------------------------------------------------------------------
@@ -17,6 +17,7 @@
 
 #include "si32Usb.h"
 #include "myUsbDevice.h"
+#include "myUsbBulk.h"
 #include "myUSB0.h"
 
 
@@ -66,7 +67,7 @@ const myUsbConfigurationDescriptorsType myUsbConfigurationDescriptors =
   .configuration.bLength             = 9,
   .configuration.bDescriptorType     = USB_DESCRIPTOR_TYPE_CONFIG,
   .configuration.wTotalLength        = CONFIG_DESC_SIZE,
-  .configuration.bNumInterfaces      = 0x01,
+  .configuration.bNumInterfaces      = 0x02,
   .configuration.bConfigurationValue = 1,           // bConfigurationValue
   .configuration.bMaxPower           = 50,          // MaxPower (in 2mA units)
   .configuration.bIndexConfiguration = 0,           // iConfiguration
@@ -95,7 +96,31 @@ const myUsbConfigurationDescriptorsType myUsbConfigurationDescriptors =
   .endpoint_interrupt_in_1.bEndpointAddress        = 0x81,       // bEndpointAddress
   .endpoint_interrupt_in_1.Type                    = USB_EP_ATTRIBUTES_TYPE_INTERRUPT,       // bmAttributes.type
   .endpoint_interrupt_in_1.wMaxPacketSize          = 64,         // MaxPacketSize Low
-  .endpoint_interrupt_in_1.bInterval               = 0x01        // bInterval
+  .endpoint_interrupt_in_1.bInterval               = 0x01,       // bInterval
+
+  .interface_bulk.bLength                 = 9,
+  .interface_bulk.bDescriptorType         = USB_DESCRIPTOR_TYPE_INTERFACE,
+  .interface_bulk.bInterfaceNumber        = BULK_INTERFACE,
+  .interface_bulk.bAlternateSetting       = 0x00,   // bAlternateSetting
+  .interface_bulk.bNumEndpoints           = 0x02,
+  .interface_bulk.bInterfaceClass         = 0xFF,   // vendor specific
+  .interface_bulk.bInterfaceSubClass      = 0x00,   // bInterfaceSubClass
+  .interface_bulk.bInterfaceProtocol      = 0x00,   // bInterfaceProcotol
+  .interface_bulk.iInterface              = 0x00,   // iInterface
+
+  .endpoint_bulk_in_2.bLength             = 7,
+  .endpoint_bulk_in_2.bDescriptorType     = USB_DESCRIPTOR_TYPE_ENDPOINT,
+  .endpoint_bulk_in_2.bEndpointAddress    = BULK_EP_IN,
+  .endpoint_bulk_in_2.Type                = USB_EP_ATTRIBUTES_TYPE_BULK,
+  .endpoint_bulk_in_2.wMaxPacketSize      = BULK_MAX_PACKET_SIZE,
+  .endpoint_bulk_in_2.bInterval           = 0x00,   // ignored for bulk
+
+  .endpoint_bulk_out_2.bLength            = 7,
+  .endpoint_bulk_out_2.bDescriptorType    = USB_DESCRIPTOR_TYPE_ENDPOINT,
+  .endpoint_bulk_out_2.bEndpointAddress   = BULK_EP_OUT,
+  .endpoint_bulk_out_2.Type               = USB_EP_ATTRIBUTES_TYPE_BULK,
+  .endpoint_bulk_out_2.wMaxPacketSize     = BULK_MAX_PACKET_SIZE,
+  .endpoint_bulk_out_2.bInterval          = 0x00    // ignored for bulk
 };
 
 
@@ -119,23 +144,118 @@ uint8_t s_KeyTable[17] =
 #pragma pack()
 
 
+//------------------------------------------------------------------------------
+// Report Ring
+//------------------------------------------------------------------------------
+// Single producer (main loop) / single consumer (EP1 IN interrupt) ring of
+// keypad reports. The indices run freely, head is only written by the main
+// loop and tail only by whoever owns EP1: the main loop while it is idle,
+// the IN interrupt while it is busy. No interrupts are masked.
+//
+// When the ring is full the newest report waits in s_ReportPending and a
+// later one replaces it, so a slow host loses intermediate key states but
+// always ends up with the last one (a key-up is never lost).
+#define HID_REPORT_RING_SIZE  8       // must be a power of 2
+#define HID_REPORT_NONE       0xFFFFFFFF
+
+static volatile uint8_t  s_ReportRing[HID_REPORT_RING_SIZE];
+static volatile uint32_t s_ReportHead;
+static volatile uint32_t s_ReportTail;
+
+// Main loop only
+static uint32_t s_ReportLast    = HID_REPORT_NONE;
+static uint32_t s_ReportPending = HID_REPORT_NONE;
+
+volatile uint32_t myHidReportsCoalesced;
+volatile uint32_t myHidReportOverflows;
+
+
 //------------------------------------------------------------------------------
 // Functions
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+static bool myHidQueueReport(uint8_t report)
+{
+  uint32_t head = s_ReportHead;
+
+  if (head - s_ReportTail >= HID_REPORT_RING_SIZE)
+    return false;
+
+  s_ReportRing[head & (HID_REPORT_RING_SIZE - 1)] = report;
+  // Publish the report after it is written
+  s_ReportHead = head + 1;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Called by the owner of EP1, returns false if there was nothing to send.
+bool myHidSendNextReport(void)
+{
+  uint32_t tail = s_ReportTail;
+  uint8_t report;
+
+  if (tail == s_ReportHead)
+    return false;
+
+  report = s_ReportRing[tail & (HID_REPORT_RING_SIZE - 1)];
+  s_ReportTail = tail + 1;
+
+  USB0_EPn_write_fifo(SI32_USB_0_EP1, &report, 1);
+  SI32_USBEP_A_set_in_packet_ready(SI32_USB_0_EP1);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Drops the queued reports, when the host (re)configures the device.
+void myHidFlushReports(void)
+{
+  s_ReportTail = s_ReportHead;
+}
+
+//------------------------------------------------------------------------------
+// Returns true while a report still waits for room in the ring.
+bool myHidService(void)
+{
+  if (s_ReportPending != HID_REPORT_NONE && myHidQueueReport(s_ReportPending))
+    s_ReportPending = HID_REPORT_NONE;
+
+  // An idle endpoint has no IN interrupt coming, so start it from here.
+  // The interrupt cannot take EP1 while it is idle.
+  if (myUSB0_ep1_state == EPN_IDLE)
+  {
+    myUSB0_ep1_state = EPN_BUSY;
+    if (!myHidSendNextReport())
+      myUSB0_ep1_state = EPN_IDLE;
+  }
+
+  return s_ReportPending != HID_REPORT_NONE;
+}
+
 //------------------------------------------------------------------------------
 void myHidTransmitKey(int key_index)
 {
+  uint8_t report = s_KeyTable[key_index];
+
   if (myUSB0_ep1_state == EPN_DISABLED)
     return;
 
-  while (myUSB0_ep1_state != EPN_IDLE)
-    ;
+  // Same as the last report queued: nothing changes for the host
+  if (report == s_ReportLast)
+  {
+    myHidReportsCoalesced++;
+    return;
+  }
+  s_ReportLast = report;
 
-  myUSB0_ep1_state = EPN_BUSY;
-  USB0_EPn_write_fifo(SI32_USB_0_EP1, &s_KeyTable[key_index], 1);
-  SI32_USBEP_A_set_in_packet_ready(SI32_USB_0_EP1);
+  // A report still waiting for room is superseded by this one
+  if (s_ReportPending != HID_REPORT_NONE)
+    myHidReportsCoalesced++;
+  s_ReportPending = report;
 
+  myHidService();
+  if (s_ReportPending != HID_REPORT_NONE)
+    myHidReportOverflows++;
 }
 
 
@@ -143,6 +263,10 @@ void myHidTransmitKey(int key_index)
 //------------------------------------------------------------------------------
 void myUsbDevice_request_handler(void)
 {
+  // Bulk self-test commands
+  if (myUsbBulk_request_handler())
+    return;
+
   switch (myUSB0_setup.wRequest)
   {
   case USB_REQUEST_STANDARD_DEVICE_GET_DESCRIPTOR: // Support device, configuration, string
@@ -178,7 +302,9 @@ void myUsbDevice_request_handler(void)
     SI32_USBEP_A_reset_in_data_toggle(SI32_USB_0_EP1);
     SI32_USBEP_A_set_in_max_packet_size(SI32_USB_0_EP1, 64>>3);
     SI32_USB_A_enable_ep1(SI32_USB_0);
+    myHidFlushReports();
     myUSB0_ep1_state=EPN_IDLE;
+    myUsbBulk_configure();
     myUSB0_ep0_state = EP0_NODATA_STATUS;
     break;
 
@@ -14,6 +14,7 @@
 //------------------------------------------------------------------------------
 // Includes
 //------------------------------------------------------------------------------
+#include <stdbool.h>
 #include "si32Usb.h"
 #include "si32UsbHid.h"
 
@@ -27,6 +28,9 @@ typedef struct myUsbConfigurationDescriptorsStruct
   si32UsbInterfaceDescriptorType     interface;
   si32UsbHidDescriptorType           hid;
   si32UsbEndpointDescriptorType      endpoint_interrupt_in_1;
+  si32UsbInterfaceDescriptorType     interface_bulk;
+  si32UsbEndpointDescriptorType      endpoint_bulk_in_2;
+  si32UsbEndpointDescriptorType      endpoint_bulk_out_2;
 } myUsbConfigurationDescriptorsType ;
 #pragma pack()
 
@@ -35,6 +39,14 @@ typedef struct myUsbConfigurationDescriptorsStruct
 //------------------------------------------------------------------------------
 extern void myUsbDevice_request_handler(void);
 extern void myHidTransmitKey(int key_index);
+extern bool myHidService(void);
+extern bool myHidSendNextReport(void);
+extern void myHidFlushReports(void);
+
+// Reports dropped because a newer one replaced them, and reports that found
+// the ring full (see myUsbDevice.c)
+extern volatile uint32_t myHidReportsCoalesced;
+extern volatile uint32_t myHidReportOverflows;
 
 extern const si32UsbDeviceDescriptorType myUsbDeviceDescriptor;
 extern const myUsbConfigurationDescriptorsType myUsbConfigurationDescriptors;
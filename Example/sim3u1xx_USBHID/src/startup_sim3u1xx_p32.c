@@ -261,11 +261,24 @@ void data_init(unsigned int romstart, unsigned int start, unsigned int len) {
 		*pulDest++ = *pulSrc++;
 }
 
+// Clears 16 bytes per STMIA, then the remaining words one at a time. The
+// zeros sit in r2-r5: r7 is the Thumb frame pointer, which GCC refuses as an
+// asm operand in an unoptimized build.
 __attribute__ ((section(".after_vectors")))
 void bss_init(unsigned int start, unsigned int len) {
 	unsigned int *pulDest = (unsigned int*) start;
-	unsigned int loop;
-	for (loop = 0; loop < len; loop = loop + 4)
+	unsigned int *pulBlockEnd = (unsigned int*) (start + (len & ~15));
+	unsigned int *pulEnd = (unsigned int*) (start + len);
+	register unsigned int z0 __asm("r2") = 0;
+	register unsigned int z1 __asm("r3") = 0;
+	register unsigned int z2 __asm("r4") = 0;
+	register unsigned int z3 __asm("r5") = 0;
+	while (pulDest < pulBlockEnd)
+		__asm volatile ("stmia %0!, {%1, %2, %3, %4}"
+			: "+r" (pulDest)
+			: "r" (z0), "r" (z1), "r" (z2), "r" (z3)
+			: "memory");
+	while (pulDest < pulEnd)
 		*pulDest++ = 0;
 }
 
@@ -281,6 +294,26 @@ extern unsigned int __data_section_table_end;
 extern unsigned int __bss_section_table;
 extern unsigned int __bss_section_table_end;
 
+//*****************************************************************************
+// Startup variants. A section whose load address is its run address (an
+// image loaded straight into SRAM) is not copied. An ELF image loaded into
+// SRAM by a loader that zeroes its .bss can also skip the clear: link with
+// -Wl,--defsym=__bss_zeroed_by_loader=1. The loaders that do are station.py
+// and the SRAM loader of si32FlashProgrammer.py (Image.fill_words), and the
+// adapter firmware with a bin_array.h from bin2c.py (.bss as a SEG_SET fill
+// of 0). A flat .bin has no record of .bss, so no loader can zero it: leave
+// the symbol undefined for those. The weak reference has address 0 when the
+// symbol is not defined.
+//*****************************************************************************
+extern unsigned int __bss_zeroed_by_loader __attribute__ ((weak));
+
+// Core cycles from ResetISR to main(), from the DWT cycle counter
+unsigned int StartupCycles;
+
+#define DEMCR       (*(volatile unsigned int *) 0xE000EDFC)
+#define DWT_CTRL    (*(volatile unsigned int *) 0xE0001000)
+#define DWT_CYCCNT  (*(volatile unsigned int *) 0xE0001004)
+
 __attribute__ ((section(".after_vectors")))
 void
 ResetISR(void) {
@@ -291,6 +324,11 @@ ResetISR(void) {
 	unsigned int LoadAddr, ExeAddr, SectionLen;
 	unsigned int *SectionTableAddr;
 
+	// Start the cycle counter (TRCENA, CYCCNTENA)
+	DEMCR |= 1 << 24;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= 1;
+
 	// Load base address of Global Section Table
 	SectionTableAddr = &__data_section_table;
 
@@ -299,14 +337,16 @@ ResetISR(void) {
 		LoadAddr = *SectionTableAddr++;
 		ExeAddr = *SectionTableAddr++;
 		SectionLen = *SectionTableAddr++;
-//		data_init(LoadAddr, ExeAddr, SectionLen);
+		if (LoadAddr != ExeAddr)
+			data_init(LoadAddr, ExeAddr, SectionLen);
 	}
 	// At this point, SectionTableAddr = &__bss_section_table;
 	// Zero fill the bss segment
 	while (SectionTableAddr < &__bss_section_table_end) {
 		ExeAddr = *SectionTableAddr++;
 		SectionLen = *SectionTableAddr++;
-		bss_init(ExeAddr, SectionLen);
+		if (!&__bss_zeroed_by_loader)
+			bss_init(ExeAddr, SectionLen);
 	}
 
 #ifdef __USE_CMSIS
@@ -320,6 +360,8 @@ ResetISR(void) {
 	__libc_init_array();
 #endif
 
+	StartupCycles = DWT_CYCCNT;
+
 #if defined (__REDLIB__)
 	// Call the Redlib library, which in turn calls main()
 	__main() ;
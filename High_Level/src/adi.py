@@ -12,16 +12,30 @@ Python wrapper for Silabs 32-bit debug adapter library (SLAB_ADI.dll).
 Documentation for the library is provided by the help file SLAB_ADI.chm.
 
 ADI - ARM Debug Interface.
+
+AdiDevice talks to an adapter through a transport. The backend is chosen
+with the ADI_BACKEND environment variable:
+    dll - SLAB_ADI.dll, Windows only. ADI_LIBRARY overrides the file name.
+    sim - in-process simulated SiM3 targets (simtarget.py), as many as
+          ADI_SIM_TARGETS says (default 1).
+
+Open item: there is no native transport for Linux or macOS yet. The USB
+protocol under SLAB_ADI.dll is not documented in this tree, so a hidapi or
+libusb AdiTransport cannot be written against it here. Until one exists the
+dll backend refuses to load off Windows; use ADI_BACKEND=sim there.
 """
 
 import ctypes
+import os
+import sys
 
-__version__ = "0.0.4"
-__date__ = "28 Nov 2012"
+__version__ = "0.0.5"
+__date__ = "19 Oct 2026"
 
 __all__ = ['ADI_VID', 'ADI_PID',
     'ADI_DEVICE_MODE', 'ADI_DAP', 'ADI_PROP_ID', 'ADI_STATUS_DESC',
-    'AdiDevice', 'AdiError', 'GetNumDevices', 'GetSerial', 'GetAttributes',
+    'AdiDevice', 'AdiError', 'AdiTransport', 'DllTransport', 'BACKEND',
+    'GetNumDevices', 'GetSerial', 'GetAttributes',
     'GetHidLibraryVersion', 'GetLibraryVersion', 'IsAvailable',
     'GetDeviceFilter', 'SetDeviceFilter',
     'GetDeviceFilterEnable', 'SetDeviceFilterEnable']
@@ -118,29 +132,54 @@ def adi_errcheck(result, func, args):
 # ARM Debug Interface DLL
 #==============================================================================
 
-_DLL = ctypes.windll.LoadLibrary("SLAB_ADI.dll")
-
-_DLL.ADI_IsOpened.restype = ctypes.c_bool
-_DLL.ADI_DBG_IsConnected.restype = ctypes.c_bool
-
-for adi_function in ["ADI_GetNumDevices",
-    "ADI_GetAttributes", "ADI_GetSerial",
-    "ADI_GetDeviceFilter", "ADI_SetDeviceFilter",
-    "ADI_GetDeviceFilterEnable", "ADI_SetDeviceFilterEnable",
-    "ADI_GetHidLibraryVersion", "ADI_GetLibraryVersion",
-    "ADI_GetBootloaderVersion", "ADI_DBG_GetDebugVersion",
-    "ADI_OpenByIndex", "ADI_Close",
-    "ADI_GetOpenedAttributes", "ADI_GetOpenedSerial",
-    "ADI_DBG_ConnectJtag", "ADI_DBG_ConnectSwd", "ADI_DBG_Disconnect",
-    "ADI_GetDeviceMode", "ADI_SetDeviceMode",
-    "ADI_DBG_GetProperty", "ADI_DBG_SetProperty",
-    "ADI_DBG_ClearErrors", "ADI_DBG_LineReset",
-    "ADI_DBG_QueueRead", "ADI_DBG_QueueWrite",
-    "ADI_DBG_RepeatRead", "ADI_DBG_RepeatWrite",
-    "ADI_DBG_StartTransfers", "ADI_BL_DownloadHexFile"]:
-    fnc = getattr(_DLL, adi_function)
-    fnc.restype = ctypes.c_ubyte
-    fnc.errcheck = adi_errcheck
+BACKEND = os.environ.get("ADI_BACKEND", "dll")
+
+# The library API uses 32-bit DWORDs
+_DWORD = ctypes.c_uint32
+
+def _LoadLibrary():
+    if sys.platform != "win32":
+        raise OSError("ADI_BACKEND=dll needs SLAB_ADI.dll on Windows; there "
+            "is no native adapter transport for %s yet (see the module "
+            "docstring), set ADI_BACKEND=sim to use the simulator" % sys.platform)
+    return ctypes.windll.LoadLibrary(os.environ.get("ADI_LIBRARY", "SLAB_ADI.dll"))
+
+_DLL = None
+_SIM = None
+
+if BACKEND == "sim":
+    import simtarget
+    _SIM = simtarget.SimLibrary(int(os.environ.get("ADI_SIM_TARGETS", "1")))
+else:
+    _DLL = _LoadLibrary()
+
+    _DLL.ADI_IsOpened.restype = ctypes.c_bool
+    _DLL.ADI_DBG_IsConnected.restype = ctypes.c_bool
+
+    for adi_function in ["ADI_GetNumDevices",
+        "ADI_GetAttributes", "ADI_GetSerial",
+        "ADI_GetDeviceFilter", "ADI_SetDeviceFilter",
+        "ADI_GetDeviceFilterEnable", "ADI_SetDeviceFilterEnable",
+        "ADI_GetHidLibraryVersion", "ADI_GetLibraryVersion",
+        "ADI_GetBootloaderVersion", "ADI_DBG_GetDebugVersion",
+        "ADI_OpenByIndex", "ADI_Close",
+        "ADI_GetOpenedAttributes", "ADI_GetOpenedSerial",
+        "ADI_DBG_ConnectJtag", "ADI_DBG_ConnectSwd", "ADI_DBG_Disconnect",
+        "ADI_GetDeviceMode", "ADI_SetDeviceMode",
+        "ADI_DBG_GetProperty", "ADI_DBG_SetProperty",
+        "ADI_DBG_ClearErrors", "ADI_DBG_LineReset",
+        "ADI_DBG_QueueRead", "ADI_DBG_QueueWrite",
+        "ADI_DBG_RepeatRead", "ADI_DBG_RepeatWrite",
+        "ADI_DBG_StartTransfers", "ADI_BL_DownloadHexFile"]:
+        fnc = getattr(_DLL, adi_function)
+        fnc.restype = ctypes.c_ubyte
+        fnc.errcheck = adi_errcheck
+
+def _RequireDll():
+    if _DLL is None:
+        # 0x42 : "ADI_STATUS_API_NOT_SUPPORTED"
+        raise AdiError(0x42)
+    return _DLL
 
 
 #==============================================================================
@@ -149,7 +188,9 @@ for adi_function in ["ADI_GetNumDevices",
 
 def GetNumDevices():
     """Returns the number of debug adapters connected to the host."""
-    cnt = ctypes.c_ulong()
+    if _SIM:
+        return _SIM.GetNumDevices()
+    cnt = _DWORD()
     _DLL.ADI_GetNumDevices(ctypes.byref(cnt))
     return cnt.value
 
@@ -157,6 +198,8 @@ def GetSerial(index=0):
     """Returns the serial number string for the debug adapter selected by index.
     Throws an error if the selected index is already open.
     """
+    if _SIM:
+        return _SIM.GetSerial(index)
     buf = ctypes.create_string_buffer(512)
     _DLL.ADI_GetSerial(index, buf)
     return buf.value.decode()
@@ -165,9 +208,11 @@ def GetAttributes(index=0):
     """Returns VID, PID and release number for the debug adapter selected by index.
     Throws an error if the selected index is already open.
     """
-    vid = ctypes.c_ulong()
-    pid = ctypes.c_ulong()
-    rel = ctypes.c_ulong()
+    if _SIM:
+        return _SIM.GetAttributes(index)
+    vid = _DWORD()
+    pid = _DWORD()
+    rel = _DWORD()
     _DLL.ADI_GetAttributes(index, ctypes.byref(vid), ctypes.byref(pid), ctypes.byref(rel))
     return tuple([vid.value, pid.value, rel.value])
 
@@ -176,6 +221,8 @@ def IsAvailable(index=0, arm_only=True):
 
     :param arm_only: if True, only checks for 32-bit adapters
     """
+    if _SIM:
+        return _SIM.IsAvailable(index)
     result = True
     handle = ctypes.c_int(0)
     try:
@@ -190,40 +237,257 @@ def IsAvailable(index=0, arm_only=True):
 
 def GetLibraryVersion():
     """Returns the SLAB_ADI library version number as a string."""
-    major = ctypes.c_ulong()
-    minor = ctypes.c_ulong()
-    release = ctypes.c_ulong()
+    if _SIM:
+        return _SIM.version
+    major = _DWORD()
+    minor = _DWORD()
+    release = _DWORD()
     _DLL.ADI_GetLibraryVersion(ctypes.byref(major), ctypes.byref(minor), ctypes.byref(release))
     return "{}.{}.{}".format(major.value, minor.value, release.value)
 
 def GetHidLibraryVersion():
     """Returns the SLABHIDDevice library version number as a string."""
-    major = ctypes.c_ulong()
-    minor = ctypes.c_ulong()
-    release = ctypes.c_ulong()
+    if _SIM:
+        return _SIM.version
+    major = _DWORD()
+    minor = _DWORD()
+    release = _DWORD()
     _DLL.ADI_GetHidLibraryVersion(ctypes.byref(major), ctypes.byref(minor), ctypes.byref(release))
     return "{}.{}.{}".format(major.value, minor.value, release.value)
 
 def GetDeviceFilter():
     """Returns (VID, PID) used when the device filter is enabled."""
-    vid = ctypes.c_ulong()
-    pid = ctypes.c_ulong()
-    _DLL.ADI_GetDeviceFilter(ctypes.byref(vid), ctypes.byref(pid))
+    vid = _DWORD()
+    pid = _DWORD()
+    _RequireDll().ADI_GetDeviceFilter(ctypes.byref(vid), ctypes.byref(pid))
     return tuple([vid.value, pid.value])
 
 def SetDeviceFilter(vid=ADI_VID.SLAB, pid=ADI_PID.UDA):
     """Sets (VID, PID) used when the device filter is enabled."""
-    _DLL.ADI_SetDeviceFilter(vid, pid)
+    _RequireDll().ADI_SetDeviceFilter(vid, pid)
 
 def GetDeviceFilterEnable():
     """Returns enable status of the device filter."""
     filter = ctypes.c_bool()
-    _DLL.ADI_GetDeviceFilterEnable(ctypes.byref(filter))
+    _RequireDll().ADI_GetDeviceFilterEnable(ctypes.byref(filter))
     return filter.value
 
 def SetDeviceFilterEnable(filter=True):
     """Enables or disables the device filter."""
-    _DLL.ADI_SetDeviceFilterEnable(filter)
+    _RequireDll().ADI_SetDeviceFilterEnable(filter)
+
+
+#==============================================================================
+# Transports
+#==============================================================================
+
+class AdiTransport:
+    """
+    Interface between AdiDevice and one adapter handle of a backend.
+
+    Transfers follow the SLAB_ADI model: QueueRead/QueueWrite only queue,
+    StartTransfers runs the queue in one round trip and returns the read
+    words, RepeatRead/RepeatWrite run at once.
+    """
+
+    def Open(self, index, debug=True):
+        raise NotImplementedError
+    def Close(self):
+        raise NotImplementedError
+    def IsOpened(self):
+        raise NotImplementedError
+    def GetOpenedAttributes(self):
+        return tuple([0, 0, 0])
+    def GetOpenedSerial(self):
+        return ""
+    def GetBootloaderVersion(self):
+        return 0
+    def GetDebugVersion(self):
+        return 0
+    def GetDeviceMode(self):
+        return ADI_DEVICE_MODE.DEBUG_ARM
+    def SetDeviceMode(self, mode):
+        pass
+    def GetProperty(self, prop_id):
+        return 0
+    def SetProperty(self, prop_id, value):
+        pass
+    def ConnectJTAG(self):
+        raise NotImplementedError
+    def ConnectSWD(self, swj=1, baud=0):
+        raise NotImplementedError
+    def Disconnect(self):
+        raise NotImplementedError
+    def IsConnected(self):
+        raise NotImplementedError
+    def ClearErrors(self):
+        raise NotImplementedError
+    def LineReset(self):
+        raise NotImplementedError
+    def QueueRead(self, address):
+        raise NotImplementedError
+    def QueueWrite(self, address, data):
+        raise NotImplementedError
+    def RepeatRead(self, count=1, address=ADI_DAP.DRW, buffer=None):
+        raise NotImplementedError
+    def RepeatWrite(self, data, address=ADI_DAP.DRW):
+        raise NotImplementedError
+    def StartTransfers(self):
+        raise NotImplementedError
+
+
+class DllTransport(AdiTransport):
+    """Adapter handle of the SLAB_ADI library."""
+
+    def __init__(self):
+        _RequireDll()
+        self.handle = ctypes.c_int(0)
+
+    def __str__(self):
+        return "Hnd:"+hex(self.handle.value)
+
+    def Open(self, index, debug=True):
+        try:
+            # throws error if index is already open
+            _DLL.ADI_OpenByIndex(ctypes.byref(self.handle), index)
+            if debug:
+                # throws error if device has 8-bit debug firmware
+                _DLL.ADI_SetDeviceMode(self.handle, ADI_DEVICE_MODE.DEBUG_ARM)
+        except AdiError:
+            if self.IsOpened():
+                _DLL.ADI_Close(self.handle)
+                self.handle.value = 0
+            raise
+
+    def Close(self):
+        if self.handle.value != 0:
+            _DLL.ADI_Close(self.handle)
+            self.handle.value = 0
+
+    def IsOpened(self):
+        return _DLL.ADI_IsOpened(self.handle)
+
+    def GetOpenedAttributes(self):
+        vid = _DWORD(0)
+        pid = _DWORD(0)
+        rel = _DWORD(0)
+        _DLL.ADI_GetOpenedAttributes(self.handle, ctypes.byref(vid), ctypes.byref(pid), ctypes.byref(rel))
+        return tuple([vid.value, pid.value, rel.value])
+
+    def GetOpenedSerial(self):
+        buf = ctypes.create_string_buffer(512)
+        _DLL.ADI_GetOpenedSerial(self.handle, buf)
+        return buf.value.decode()
+
+    def GetBootloaderVersion(self):
+        version = _DWORD(0)
+        _DLL.ADI_GetBootloaderVersion(self.handle, ctypes.byref(version))
+        return version.value
+
+    def GetDebugVersion(self):
+        version = _DWORD(0)
+        _DLL.ADI_DBG_GetDebugVersion(self.handle, ctypes.byref(version))
+        return version.value
+
+    def GetDeviceMode(self):
+        mode = _DWORD()
+        _DLL.ADI_GetDeviceMode(self.handle, ctypes.byref(mode))
+        return mode.value
+
+    def SetDeviceMode(self, mode):
+        _DLL.ADI_SetDeviceMode(self.handle, mode)
+
+    def GetProperty(self, prop_id):
+        value = _DWORD()
+        _DLL.ADI_DBG_GetProperty(self.handle, prop_id, ctypes.byref(value))
+        return value.value
+
+    def SetProperty(self, prop_id, value):
+        _DLL.ADI_DBG_SetProperty(self.handle, prop_id, value)
+
+    def ConnectJTAG(self):
+        id_code = _DWORD()
+        _DLL.ADI_DBG_ConnectJtag(self.handle, 0, 0, 0, 0, ctypes.byref(id_code))
+        return id_code.value
+
+    def ConnectSWD(self, swj=1, baud=0):
+        id_code = _DWORD()
+        _DLL.ADI_DBG_ConnectSwd(self.handle, swj, (0 != baud), baud, ctypes.byref(id_code))
+        return id_code.value
+
+    def Disconnect(self):
+        _DLL.ADI_DBG_Disconnect(self.handle)
+
+    def IsConnected(self):
+        if self.handle.value != 0:
+            return _DLL.ADI_DBG_IsConnected(self.handle)
+        else:
+            return False
+
+    def ClearErrors(self):
+        before = _DWORD()
+        after = _DWORD()
+        _DLL.ADI_DBG_ClearErrors(self.handle, ctypes.byref(before), ctypes.byref(after))
+        return tuple([before.value, after.value])
+
+    def LineReset(self):
+        _DLL.ADI_DBG_LineReset(self.handle)
+
+    def QueueRead(self, address):
+        _DLL.ADI_DBG_QueueRead(self.handle, (address | 0x02))
+
+    def QueueWrite(self, address, data):
+        _DLL.ADI_DBG_QueueWrite(self.handle, address, data)
+
+    def RepeatRead(self, count=1, address=ADI_DAP.DRW, buffer=None):
+        """Reads count words from one DAP register.
+
+        :param buffer: optional writable buffer (bytearray, array('I'),
+         memoryview) of at least count words that receives the data and is
+         returned instead of a list
+        """
+        if buffer is not None:
+            words = (ctypes.c_uint32 * count).from_buffer(buffer)
+            _DLL.ADI_DBG_RepeatRead(self.handle, count, (address | 0x02), words)
+            return buffer
+        words = (ctypes.c_uint32 * count)()
+        _DLL.ADI_DBG_RepeatRead(self.handle, count, (address | 0x02), words)
+        return list(words)
+
+    def RepeatWrite(self, data, address=ADI_DAP.DRW):
+        """Writes words to one DAP register.
+
+        :param data: sequence of words, or a buffer (bytes, array('I'),
+         memoryview) of little endian words that is passed without conversion
+        """
+        try:
+            view = memoryview(data).cast('B')
+        except TypeError:
+            view = None
+        if view is not None:
+            count = len(view) // 4
+            if view.readonly:
+                words = (ctypes.c_uint32 * count).from_buffer_copy(view)
+            else:
+                words = (ctypes.c_uint32 * count).from_buffer(view)
+        else:
+            count = len(data)
+            words = (ctypes.c_uint32 * count)(*data)
+        _DLL.ADI_DBG_RepeatWrite(self.handle, count, address, words)
+
+    def StartTransfers(self):
+        size = _DWORD()
+        _DLL.ADI_DBG_GetNumReads(self.handle, ctypes.byref(size))
+        read = _DWORD()
+        words = (_DWORD * size.value)()
+        _DLL.ADI_DBG_StartTransfers(self.handle, words, size, ctypes.byref(read))
+        return list(words)
+
+
+def _NewTransport():
+    if _SIM:
+        return _SIM.NewTransport()
+    return DllTransport()
 
 
 #==============================================================================
@@ -235,47 +499,45 @@ class AdiDevice:
     AdiDevice instances are used to work with a specific debug adapter.
 
     For documentation on the wrapped functions, refer to the help file SLAB_ADI.chm.
+
+    :param transport: AdiTransport to use, a new one of the selected backend
+     by default
     """
 
-    def __init__(self, index=None):
-        self.handle = ctypes.c_int(0)
+    def __init__(self, index=None, transport=None):
+        if transport is None:
+            transport = _NewTransport()
+        self.transport = transport
         self.idcode = 0
         GetNumDevices()
 
     def __str__(self):
-        return "AdiDevice Hnd:"+hex(self.handle.value)+" Id:"+hex(self.idcode)
+        return "AdiDevice "+str(self.transport)+" Id:"+hex(self.idcode)
 
     @property
     def vid_pid(self):
-        vid = ctypes.c_ulong(0)
-        pid = ctypes.c_ulong(0)
-        rel = ctypes.c_ulong(0)
         if self.IsOpened():
-            _DLL.ADI_GetOpenedAttributes(self.handle, ctypes.byref(vid), ctypes.byref(pid), ctypes.byref(rel))
-        return tuple([vid.value, pid.value])
+            return self.transport.GetOpenedAttributes()[0:2]
+        return tuple([0, 0])
 
     @property
     def serial_number(self):
-        buf = ctypes.create_string_buffer(512)
         if self.IsOpened():
-            _DLL.ADI_GetOpenedSerial(self.handle, buf)
-        return buf.value.decode()
+            return self.transport.GetOpenedSerial()
+        return ""
 
     @property
     def bootload_version(self):
-        version = ctypes.c_ulong(0)
         if self.IsOpened():
-            _DLL.ADI_GetBootloaderVersion(self.handle, ctypes.byref(version))
-        return version.value
+            return self.transport.GetBootloaderVersion()
+        return 0
 
     @property
     def firmware_version(self):
-        version = ctypes.c_ulong(0)
         try:
-            _DLL.ADI_DBG_GetDebugVersion(self.handle, ctypes.byref(version))
+            return self.transport.GetDebugVersion()
         except AdiError:
-            pass
-        return version.value
+            return 0
 
     def OpenByIndex(self, index, debug=True):
         """Trys to open adapter selected by the driver index.
@@ -284,17 +546,7 @@ class AdiDevice:
         """
         if self.IsOpened():
             self.Close()
-        try:
-            # throws error if index is already open
-            _DLL.ADI_OpenByIndex(ctypes.byref(self.handle), index)
-            if debug:
-                # throws error if device has 8-bit debug firmware
-                _DLL.ADI_SetDeviceMode(self.handle, ADI_DEVICE_MODE.DEBUG_ARM)
-        except AdiError:
-            if self.IsOpened():
-                _DLL.ADI_Close(self.handle)
-                self.handle.value = 0
-            raise
+        self.transport.Open(index, debug)
 
     def OpenBySerial(self, serial, debug=True):
         """Trys to open adapter with the specified serial number.
@@ -324,87 +576,63 @@ class AdiDevice:
         raise AdiError(0x80)
 
     def Close(self):
-        if self.handle.value != 0:
+        if self.IsOpened():
             self.Disconnect()
-            _DLL.ADI_Close(self.handle)
-            self.handle.value = 0
+            self.transport.Close()
 
     def IsOpened(self):
-        return _DLL.ADI_IsOpened(self.handle)
+        return self.transport.IsOpened()
 
     def GetDeviceMode(self):
-        mode = ctypes.c_ulong()
-        _DLL.ADI_GetDeviceMode(self.handle, ctypes.byref(mode))
-        return mode.value
+        return self.transport.GetDeviceMode()
 
     def SetDeviceMode(self, mode):
-        _DLL.ADI_SetDeviceMode(self.handle, mode)
+        self.transport.SetDeviceMode(mode)
 
     def GetProperty(self, prop_id):
-        value = ctypes.c_ulong()
-        _DLL.ADI_DBG_GetProperty(self.handle, prop_id, ctypes.byref(value))
-        return value.value
+        return self.transport.GetProperty(prop_id)
 
     def SetProperty(self, prop_id, value):
-        _DLL.ADI_DBG_SetProperty(self.handle, prop_id, value)
+        self.transport.SetProperty(prop_id, value)
 
     def ConnectJTAG(self):
-        id_code = ctypes.c_ulong()
-        _DLL.ADI_DBG_ConnectJtag(self.handle, 0, 0, 0, 0, ctypes.byref(id_code))
-        self.idcode = id_code.value
+        self.idcode = self.transport.ConnectJTAG()
         self.ClearErrors()
-        return id_code.value
+        return self.idcode
 
     def ConnectSWD(self, swj=1, baud=0):
-        id_code = ctypes.c_ulong()
-        _DLL.ADI_DBG_ConnectSwd(self.handle, swj, (0 != baud), baud, ctypes.byref(id_code))
-        self.idcode = id_code.value
+        self.idcode = self.transport.ConnectSWD(swj, baud)
         self.ClearErrors()
-        return id_code.value
+        return self.idcode
 
     def Disconnect(self):
         self.idcode = 0
         if self.IsConnected():
-            _DLL.ADI_DBG_Disconnect(self.handle)
+            self.transport.Disconnect()
 
     def IsConnected(self):
-        if self.handle.value != 0:
-            return _DLL.ADI_DBG_IsConnected(self.handle)
-        else:
-            return False
+        return self.transport.IsConnected()
 
     def ClearErrors(self):
-        before = ctypes.c_ulong()
-        after = ctypes.c_ulong()
-        _DLL.ADI_DBG_ClearErrors(self.handle, ctypes.byref(before), ctypes.byref(after))
-        return tuple([before.value, after.value])
+        return self.transport.ClearErrors()
 
     def LineReset(self):
-        _DLL.ADI_DBG_LineReset(self.handle)
+        self.transport.LineReset()
 
     def QueueRead(self, address):
-        _DLL.ADI_DBG_QueueRead(self.handle, (address | 0x02))
+        self.transport.QueueRead(address)
 
     def QueueWrite(self, address, data):
-        _DLL.ADI_DBG_QueueWrite(self.handle, address, data)
+        self.transport.QueueWrite(address, data)
 
-    def RepeatRead(self, count=1, address=ADI_DAP.DRW):
-        words = (ctypes.c_ulong * count)()
-        _DLL.ADI_DBG_RepeatRead(self.handle, count, (address | 0x02), words)
-        return list(words)
+    def RepeatRead(self, count=1, address=ADI_DAP.DRW, buffer=None):
+        return self.transport.RepeatRead(count, address, buffer)
 
     def RepeatWrite(self, data, address=ADI_DAP.DRW):
-        count = len(data)
-        words = (ctypes.c_ulong * count)(*data)
-        _DLL.ADI_DBG_RepeatWrite(self.handle, count, address, words)
+        self.transport.RepeatWrite(data, address)
 
     def StartTransfers(self):
-        size = ctypes.c_ulong()
-        _DLL.ADI_DBG_GetNumReads(self.handle, ctypes.byref(size))
-        read = ctypes.c_ulong()
-        words = (ctypes.c_ulong * size.value)()
-        _DLL.ADI_DBG_StartTransfers(self.handle, words, size, ctypes.byref(read))
-        return list(words)
+        return self.transport.StartTransfers()
 
 
 if __name__ == "__main__":
@@ -0,0 +1,381 @@
+
+"""
+Programming throughput benchmark.
+
+Sweeps SRAM write and read, flash erase, program and verify across chunk
+sizes (words per RepeatRead/RepeatWrite, the 1 KB default of
+swd_write_mem/programming_sram included), CSW access widths, the batching
+depth of queued transfers and the transport backends, and prints one CSV
+row per case:
+
+	backend,operation,width,mode,chunk_bytes,batch,bytes,seconds,
+	bytes_per_s,packets,packets_per_byte,transfers,ok
+
+A packet is one adapter round trip (StartTransfers, RepeatRead or
+RepeatWrite). seconds is the median of the repeats. On the sim backend it is
+the virtual time of its latency model, elsewhere wall time.
+
+The session_mixed case interleaves reads and writes in one DapSession queue
+longer than SESSION_MAX_QUEUE; ok is 0 when a read result goes missing.
+
+Each backend runs in its own process because adi.py picks the backend at
+import. Backends that cannot be loaded are skipped with a note on stderr.
+The flash cases erase and overwrite the first pages of a real target.
+
+Usage: python bench.py [-b sim,dll] [-n repeats] [--sram-bytes n]
+	[--flash-bytes n] [--no-flash] [-o out.csv]
+"""
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import time
+from array import array
+
+# Sweep defaults
+CHUNK_BYTES = (64, 256, 1024)
+WIDTHS = (8, 16, 32)
+BATCH_DEPTHS = (1, 16, 64)
+FLASH_BATCH_HALFWORDS = (2, 16, 64, 256)
+
+SRAM_BYTES = 8192
+FLASH_BYTES = 4096
+FLASH_PAGE_SIZE = 0x400
+
+# Bench data goes to the start of SRAM, below the ram_runner area
+SRAM_BENCH_ADDR = 0x20000000
+FLASH_BENCH_ADDR = 0
+
+CSV_COLUMNS = ('backend', 'operation', 'width', 'mode', 'chunk_bytes', 'batch',
+	'bytes', 'seconds', 'bytes_per_s', 'packets', 'packets_per_byte', 'transfers', 'ok')
+
+# CSW.SIZE and the address increment for each width
+CSW_SIZE = {8: 0x0, 16: 0x1, 32: 0x2}
+CSW_BASE = 0x23000010
+
+class CountingTransport:
+	"""Counts the round trips and DAP transfers of any transport."""
+
+	def __init__(self, transport):
+		self.transport = transport
+		self.packets = 0
+		self.transfers = 0
+		self.queued = 0
+
+	def __getattr__(self, name):
+		return getattr(self.transport, name)
+
+	def __str__(self):
+		return str(self.transport)
+
+	def QueueRead(self, address):
+		self.queued += 1
+		self.transport.QueueRead(address)
+
+	def QueueWrite(self, address, data):
+		self.queued += 1
+		self.transport.QueueWrite(address, data)
+
+	def StartTransfers(self):
+		self.packets += 1
+		self.transfers += self.queued
+		self.queued = 0
+		return self.transport.StartTransfers()
+
+	def RepeatRead(self, count=1, address=0x0D, buffer=None):
+		self.packets += 1
+		self.transfers += count
+		return self.transport.RepeatRead(count, address, buffer)
+
+	def RepeatWrite(self, data, address=0x0D):
+		self.packets += 1
+		if isinstance(data, (list, tuple)):
+			self.transfers += len(data)
+		else:
+			self.transfers += len(memoryview(data).cast('B')) // 4
+		self.transport.RepeatWrite(data, address)
+
+	def clock(self):
+		"""Seconds by the sim latency model, or wall time."""
+		virtual = getattr(self.transport, 'virtual_time', None)
+		if virtual is not None:
+			return virtual
+		return time.monotonic()
+
+
+#------------------------------------------------------------------------------
+# Parameterized transfers
+#------------------------------------------------------------------------------
+
+def lane_values(data, width):
+	"""Bytes as DRW values for one access each, placed in their byte lanes."""
+
+	step = width // 8
+	values = []
+	for offset in range(0, len(data), step):
+		value = int.from_bytes(data[offset:offset + step], 'little')
+		values.append(value << ((offset & 3) * 8))
+	return values
+
+def lane_bytes(values, width, length):
+	"""Inverse of lane_values for values read back."""
+
+	step = width // 8
+	out = bytearray()
+	for n, value in enumerate(values):
+		offset = n * step
+		out += ((value >> ((offset & 3) * 8)) & ((1 << width) - 1)).to_bytes(step, 'little')
+	return bytes(out[:length])
+
+def chunks(address, length, chunk):
+	"""(offset, count) pieces of at most chunk bytes inside 1 KB TAR blocks."""
+
+	x = 0
+	while x < length:
+		block = 0x400 - ((address + x) & 0x3FF)
+		count = min(length - x, chunk, block)
+		yield x, count
+		x += count
+
+def mem_write(uda, prog, address, data, width, mode, chunk, batch):
+	"""Write bytes with one access per width, as RepeatWrite chunks or as
+	queued transfers batch deep."""
+
+	uda.QueueWrite(prog.DP_SELECT, prog.MEMAP_BANK_0)
+	uda.QueueWrite(prog.MEMAP_CSW, CSW_BASE | CSW_SIZE[width])
+	for x, count in chunks(address, len(data), chunk):
+		values = lane_values(data[x:x + count], width) if width != 32 else \
+			array('I', data[x:x + count])
+		uda.QueueWrite(prog.MEMAP_TAR, address + x)
+		if mode == 'repeat':
+			uda.StartTransfers()
+			uda.RepeatWrite(values, prog.MEMAP_DRW)
+			continue
+		queued = 1
+		for value in values:
+			uda.QueueWrite(prog.MEMAP_DRW, value)
+			queued += 1
+			if queued >= batch:
+				uda.StartTransfers()
+				queued = 0
+		if queued:
+			uda.StartTransfers()
+
+def mem_read(uda, prog, address, length, width, mode, chunk, batch):
+	"""Read length bytes back the same way mem_write writes them."""
+
+	out = bytearray()
+	uda.QueueWrite(prog.DP_SELECT, prog.MEMAP_BANK_0)
+	uda.QueueWrite(prog.MEMAP_CSW, CSW_BASE | CSW_SIZE[width])
+	for x, count in chunks(address, length, chunk):
+		n = count // (width // 8)
+		uda.QueueWrite(prog.MEMAP_TAR, address + x)
+		if mode == 'repeat':
+			uda.StartTransfers()
+			values = uda.RepeatRead(n, prog.MEMAP_DRW)
+		else:
+			uda.StartTransfers()
+			values = []
+			for y in range(0, n, batch):
+				for z in range(min(batch, n - y)):
+					uda.QueueRead(prog.MEMAP_DRW)
+				values += uda.StartTransfers()
+		if width == 32:
+			out += array('I', values).tobytes()
+		else:
+			out += lane_bytes(values, width, count)
+	return bytes(out)
+
+def flash_program(uda, prog, address, data, batch):
+	"""write_sequential_words with batch halfwords per round trip, where
+	write_sequential_words itself sends 2."""
+
+	base = prog.FLASHCTRL_BASE_ADDRESS
+	prog.write_AHB(uda, base + prog.OFF_FLASH_CONFIG_CLR, prog.MASK_FLASH_CONFIG_ERASE_ENABLE)
+	prog.write_AHB(uda, base + prog.OFF_FLASH_WRITE_ADDRESS, address)
+	prog.write_AHB(uda, base + prog.OFF_FLASH_CONFIG_SET, prog.MASK_FLASH_CONFIG_SEQUENTIAL)
+	prog.write_AHB(uda, base + prog.OFF_FLASH_WRITE_KEY, 0xA5)
+	prog.write_AHB(uda, base + prog.OFF_FLASH_WRITE_KEY, 0xF2)
+	uda.QueueWrite(prog.DP_SELECT, prog.MEMAP_BANK_0)
+	uda.QueueWrite(prog.MEMAP_CSW, 0x23000002)
+	uda.QueueWrite(prog.MEMAP_TAR, base + prog.OFF_FLASH_WRITE_DATA)
+	uda.StartTransfers()
+
+	halfwords = array('H', data)
+	for x in range(0, len(halfwords), batch):
+		uda.RepeatWrite(list(halfwords[x:x + batch]), prog.MEMAP_DRW)
+
+	prog.wait_flash_idle(uda)
+	prog.write_AHB(uda, base + prog.OFF_FLASH_WRITE_KEY, 0x5A)
+
+
+#------------------------------------------------------------------------------
+# Cases
+#------------------------------------------------------------------------------
+
+class Bench:
+	def __init__(self, uda, prog, backend, repeats, out):
+		self.uda = uda
+		self.prog = prog
+		self.backend = backend
+		self.repeats = repeats
+		self.out = out
+		self.counter = uda.transport
+
+	def case(self, operation, nbytes, fn, width='', mode='', chunk='', batch='', setup=None):
+		"""Run fn repeats times and write the CSV row. fn returns False when
+		the data did not check out, setup runs untimed before each repeat."""
+
+		times = []
+		ok = True
+		packets = transfers = 0
+		for r in range(self.repeats):
+			if setup:
+				setup()
+			p0, t0 = self.counter.packets, self.counter.transfers
+			start = self.counter.clock()
+			ok = fn() is not False and ok
+			times.append(self.counter.clock() - start)
+			packets = self.counter.packets - p0
+			transfers = self.counter.transfers - t0
+		seconds = statistics.median(times)
+		row = (self.backend, operation, width, mode, chunk, batch, nbytes,
+			'%.6f' % seconds, '%.0f' % (nbytes / seconds) if seconds else '',
+			packets, '%.4f' % (packets / nbytes), transfers, int(ok))
+		self.out.write(','.join(str(c) for c in row) + '\n')
+		self.out.flush()
+
+	def transfer_modes(self, widths):
+		for width in widths:
+			for chunk in CHUNK_BYTES:
+				yield width, 'repeat', chunk, ''
+			for depth in BATCH_DEPTHS:
+				yield width, 'queue', 1024, depth
+
+	def sram(self, nbytes, widths):
+		uda, prog = self.uda, self.prog
+		data = bytes((x * 7 + 3) & 0xFF for x in range(nbytes))
+		for width, mode, chunk, batch in self.transfer_modes(widths):
+			args = (width, mode, chunk, batch or 1)
+			self.case('sram_write', nbytes,
+				lambda: mem_write(uda, prog, SRAM_BENCH_ADDR, data, *args),
+				width, mode, chunk, batch)
+			self.case('sram_read', nbytes,
+				lambda: mem_read(uda, prog, SRAM_BENCH_ADDR, nbytes, *args) == data,
+				width, mode, chunk, batch)
+
+	def session_mixed(self, nbytes):
+		"""Reads and writes through one DapSession queue, longer than
+		SESSION_MAX_QUEUE. Every fourth word is read, the others are written
+		back unchanged, and all reads must come back from StartTransfers."""
+
+		uda, prog = self.uda, self.prog
+		nbytes = min(nbytes, 0x400)
+		data = bytes((x * 11 + 1) & 0xFF for x in range(nbytes))
+		words = array('I', data)
+
+		def mixed():
+			session = prog.DapSession(uda)
+			session.QueueWrite(prog.DP_SELECT, prog.MEMAP_BANK_0)
+			session.QueueWrite(prog.MEMAP_CSW, CSW_BASE | CSW_SIZE[32])
+			session.QueueWrite(prog.MEMAP_TAR, SRAM_BENCH_ADDR)
+			for n, word in enumerate(words):
+				if n % 4 == 0:
+					session.QueueRead(prog.MEMAP_DRW)
+				else:
+					session.QueueWrite(prog.MEMAP_DRW, word)
+			return list(session.StartTransfers()) == list(words[::4])
+		self.case('session_mixed', nbytes, mixed, 32, 'queue', 1024,
+			prog.SESSION_MAX_QUEUE,
+			setup=lambda: mem_write(uda, prog, SRAM_BENCH_ADDR, data, 32, 'repeat', 1024, 1))
+
+	def flash(self, nbytes):
+		uda, prog = self.uda, self.prog
+		pages = -(-nbytes // FLASH_PAGE_SIZE)
+		data = bytes((x * 13 + 5) & 0xFF for x in range(nbytes))
+
+		def erase_pages():
+			for n in range(pages):
+				prog.erase_page(uda, FLASH_BENCH_ADDR + n * FLASH_PAGE_SIZE)
+		self.case('flash_erase_page', pages * FLASH_PAGE_SIZE, erase_pages, mode='page')
+		self.case('flash_erase_mass', pages * FLASH_PAGE_SIZE, lambda: prog.device_erase(uda), mode='mass')
+		# Mass erase resets the core through the Chip_AP
+		prog.connect_and_halt_core(uda)
+		prog.enable_flashctrl_clock(uda)
+
+		words = array('I', data)
+		self.case('flash_program', nbytes,
+			lambda: prog.write_sequential_words(uda, FLASH_BENCH_ADDR, words, len(words)),
+			32, 'word', '', 2, setup=erase_pages)
+		for batch in FLASH_BATCH_HALFWORDS[1:]:
+			self.case('flash_program', nbytes,
+				lambda: flash_program(uda, prog, FLASH_BENCH_ADDR, data, batch),
+				32, 'repeat', '', batch, setup=erase_pages)
+
+		for chunk in CHUNK_BYTES:
+			self.case('flash_verify', nbytes,
+				lambda: mem_read(uda, prog, FLASH_BENCH_ADDR, nbytes, 32, 'repeat', chunk, 1) == data,
+				32, 'repeat', chunk)
+
+def run(args, out):
+	"""Benchmark the backend adi.py was imported with."""
+
+	import adi
+	import si32FlashProgrammer as prog
+
+	uda = adi.AdiDevice()
+	uda.transport = CountingTransport(uda.transport)
+	uda.Open()
+	try:
+		uda.ConnectSWD()
+		uda.LineReset()
+		prog.write_DAP(uda, prog.MEMAP_BANK_0, prog.DP_CTRLSTAT, 0x50000000)
+		prog.connect_and_halt_core(uda)
+		prog.enable_flashctrl_clock(uda)
+
+		bench = Bench(uda, prog, adi.BACKEND, args.repeats, out)
+		bench.sram(args.sram_bytes, WIDTHS)
+		bench.session_mixed(args.sram_bytes)
+		if not args.no_flash:
+			bench.flash(args.flash_bytes)
+
+		prog.write_DAP(uda, prog.MEMAP_BANK_0, prog.DP_CTRLSTAT, 0x00000000)
+	finally:
+		uda.Close()
+
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser(description='Programming throughput benchmark.')
+	parser.add_argument('-b', '--backends', default='sim,dll')
+	parser.add_argument('-n', '--repeats', type=int, default=3)
+	parser.add_argument('--sram-bytes', type=int, default=SRAM_BYTES)
+	parser.add_argument('--flash-bytes', type=int, default=FLASH_BYTES)
+	parser.add_argument('--no-flash', action='store_true')
+	parser.add_argument('-o', '--output')
+	parser.add_argument('--child', action='store_true', help=argparse.SUPPRESS)
+	args = parser.parse_args()
+
+	if args.child:
+		run(args, sys.stdout)
+		sys.exit(0)
+
+	out = open(args.output, 'w') if args.output else sys.stdout
+	out.write(','.join(CSV_COLUMNS) + '\n')
+	out.flush()
+	for backend in args.backends.split(','):
+		env = dict(os.environ, ADI_BACKEND=backend)
+		cmd = [sys.executable, os.path.abspath(__file__), '--child',
+			'-n', str(args.repeats), '--sram-bytes', str(args.sram_bytes),
+			'--flash-bytes', str(args.flash_bytes)]
+		if args.no_flash:
+			cmd.append('--no-flash')
+		child = subprocess.run(cmd, env=env, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+			universal_newlines=True)
+		out.write(child.stdout)
+		if child.returncode:
+			error = child.stderr.strip().splitlines()
+			sys.stderr.write('%s backend skipped: %s\n' % (backend, error[-1] if error else child.returncode))
+	if out is not sys.stdout:
+		out.close()
@@ -1,29 +1,304 @@
+import binascii
+import struct
 import sys
 
+import image
+
 # input_file = "sim3u1xx_USBHID_ram.bin"
 input_file ="sim3u1xx_Blinky.bin"
 output_file = "bin_array.h"
-ifile = open(input_file, mode = 'rb')
-binraw = ifile.read()
-word_array = []
-for i in range(0, len(binraw), 4):
-	if (sys.version_info < (3, 0, 0)):
-		b0 = ord(binraw[i])
-		b1 = ord(binraw[i + 1])
-		b2 = ord(binraw[i + 2])
-		b3 = ord(binraw[i + 3])
+
+# Emit binlz[] (LZ compressed) instead of binraw[]. The adapter firmware
+# decompresses it while shifting it into the target, see programming_sram().
+compressed = False
+
+# Load address of a flat .bin input. ELF and Intel HEX inputs carry their own.
+base_address = 0x20000000
+
+# Segment flags, must match SEGMENT in SW_Interface/32bit_prog_defs.h
+SEG_FILL = 0x01		# No data in the image, nothing is shifted over SWD
+SEG_ENTRY = 0x02	# Starts with the vector table
+SEG_CRC = 0x04		# crc holds the CRC16-CCITT of the segment bytes
+SEG_SET = 0x08		# Fill: set to value by code running on the target
+
+# Gaps of up to this many bytes between two pieces of data are programmed as
+# zeros rather than starting a new segment, which costs a table entry and a
+# TAR write of its own.
+SEG_MERGE_GAP = 16
+
+# Runs of at least this many equal words are cut out of the data and set on
+# the target instead. Starting the fill code costs about as many SWD
+# transfers as shifting this many words.
+FILL_MIN_WORDS = 32
+
+
+# LZ format, must match the decoder in SW_Interface/main.c
+#
+# A stream of sequences, each one:
+#   token     - high nibble: literal count, low nibble: match length code
+#   [ext]     - literal count extension if the nibble is 15 (add bytes until < 255)
+#   literals  - literal bytes
+#   offset    - match distance in bytes (1..LZ_WINDOW), only if match code != 0
+#   [ext]     - match length extension if the code is 15
+# Match length is code + LZ_MIN_MATCH - 1. Decoding stops once BINLZ_SIZE
+# bytes have been produced. One byte offsets keep the decoder history in a
+# 256 byte ring, and Thumb-2 code repeats mostly in short, near sequences.
+LZ_WINDOW = 255
+LZ_MIN_MATCH = 3
+LZ_MAX_MATCH = 255
+
+def lz_extend(out, count):
+	while count >= 255:
+		out.append(255)
+		count = count - 255
+	out.append(count)
+
+def lz_sequence(out, literals, match_len, offset):
+	lit = len(literals)
+	code = 0
+	if match_len:
+		code = match_len - LZ_MIN_MATCH + 1
+	out.append((min(lit, 15) << 4) | min(code, 15))
+	if lit >= 15:
+		lz_extend(out, lit - 15)
+	out.extend(literals)
+	if match_len:
+		out.append(offset)
+		if code >= 15:
+			lz_extend(out, code - 15)
+
+def lz_compress(data):
+	"""Greedy LZ77 over a LZ_WINDOW byte window."""
+	out = bytearray()
+	heads = {}
+	i = 0
+	lit_start = 0
+	n = len(data)
+	while i < n:
+		best_len = 0
+		best_off = 0
+		key = bytes(data[i:i + LZ_MIN_MATCH])
+		for j in reversed(heads.get(key, [])):
+			if i - j > LZ_WINDOW:
+				break
+			l = 0
+			while i + l < n and l < LZ_MAX_MATCH and data[j + l] == data[i + l]:
+				l = l + 1
+			if l > best_len:
+				best_len = l
+				best_off = i - j
+		step = 1
+		if best_len >= LZ_MIN_MATCH:
+			lz_sequence(out, data[lit_start:i], best_len, best_off)
+			step = best_len
+		for k in range(i, min(i + step, n)):
+			heads.setdefault(bytes(data[k:k + LZ_MIN_MATCH]), []).append(k)
+		i = i + step
+		if step > 1:
+			lit_start = i
+	if lit_start < n:
+		lz_sequence(out, data[lit_start:n], 0, 0)
+	return out
+
+def lz_decompress(src, size):
+	"""Reference decoder, mirrors the adapter firmware."""
+	out = bytearray()
+	i = 0
+	while len(out) < size:
+		token = src[i]
+		i = i + 1
+		lit = token >> 4
+		if lit == 15:
+			while True:
+				lit = lit + src[i]
+				i = i + 1
+				if src[i - 1] != 255:
+					break
+		out.extend(src[i:i + lit])
+		i = i + lit
+		code = token & 0x0F
+		if len(out) >= size or code == 0:
+			continue
+		offset = src[i]
+		i = i + 1
+		if code == 15:
+			while True:
+				code = code + src[i]
+				i = i + 1
+				if src[i - 1] != 255:
+					break
+		for k in range(code + LZ_MIN_MATCH - 1):
+			out.append(out[-offset])
+	return out
+
+
+def read_image(filename, address):
+	"""A .bin (one piece of data at address) or ELF file, returns
+	(pieces, fills)."""
+	try:
+		img = image.Image(filename, address)
+	except image.ImageError as e:
+		sys.exit(filename + ": " + str(e))
+	pieces = [(a, bytearray(data)) for a, data in img.segments]
+	fills = img.fills
+	img.close()
+	return pieces, fills
+
+def read_hex(filename):
+	"""Intel HEX data records, returns (pieces, fills)."""
+	pieces = []
+	upper = 0
+	f = open(filename, mode = 'r')
+	for line in f:
+		line = line.strip()
+		if not line.startswith(':'):
+			continue
+		rec = bytearray(binascii.unhexlify(line[1:]))
+		if sum(rec) & 0xFF:
+			sys.exit("HEX checksum error: " + line)
+		count, offset, rtype = rec[0], (rec[1] << 8) | rec[2], rec[3]
+		data = rec[4:4 + count]
+		if rtype == 0:
+			pieces.append((upper + offset, data))
+		elif rtype == 1:
+			break
+		elif rtype == 2:
+			upper = ((data[0] << 8) | data[1]) << 4
+		elif rtype == 4:
+			upper = ((data[0] << 8) | data[1]) << 16
+	f.close()
+	return pieces, []
+
+def make_segments(pieces, fills):
+	"""Merge the pieces into word aligned segments, [address, data, flags,
+	value] with data the byte length for fills. The lowest segment holds the
+	vector table."""
+	segments = []
+	for address, data in sorted(pieces, key = lambda p: p[0]):
+		if len(data) == 0:
+			continue
+		if segments and address <= segments[-1][0] + len(segments[-1][1]) + SEG_MERGE_GAP:
+			seg = segments[-1]
+			start = address - seg[0]
+			if start > len(seg[1]):
+				seg[1].extend(bytes(start - len(seg[1])))
+			seg[1][start:start + len(data)] = data
+		else:
+			segments.append([address, bytearray(data), SEG_CRC, 0])
+	for seg in segments:
+		# Pad both ends to a whole word
+		seg[1][0:0] = bytes(seg[0] & 3)
+		seg[0] = seg[0] & ~3
+		seg[1].extend(bytes(-len(seg[1]) % 4))
+	if not segments:
+		sys.exit("no data in " + input_file)
+	segments[0][2] |= SEG_ENTRY
+	for address, size in sorted(fills):
+		# The load data was padded with zeros up to the next word already
+		end = (address + size + 3) & ~3
+		address = (address + 3) & ~3
+		if end > address:
+			# .bss: zeroed on the target like any other SEG_SET fill, so the
+			# image may skip its own clear (__bss_zeroed_by_loader)
+			segments.append([address, end - address, SEG_FILL | SEG_SET | SEG_CRC, 0])
+	return segments
+
+def split_runs(segments):
+	"""Cut runs of FILL_MIN_WORDS or more equal words out of the data
+	segments into SEG_SET fills."""
+	out = []
+	for address, data, flags, value in segments:
+		if flags & SEG_FILL:
+			out.append([address, data, flags, value])
+			continue
+		words = struct.unpack('<%dI' % (len(data) // 4), bytes(data))
+		start = 0
+		i = 0
+		# Leave the vector table in place, start_target reads it back
+		if flags & SEG_ENTRY:
+			i = 2
+		while i < len(words):
+			j = i + 1
+			while j < len(words) and words[j] == words[i]:
+				j = j + 1
+			if j - i >= FILL_MIN_WORDS:
+				if i > start:
+					out.append([address + start * 4, data[start * 4:i * 4], flags, 0])
+					flags = flags & ~SEG_ENTRY
+				out.append([address + i * 4, (j - i) * 4, SEG_FILL | SEG_SET | SEG_CRC, words[i]])
+				start = j
+			i = j
+		if start < len(words):
+			out.append([address + start * 4, data[start * 4:], flags, 0])
+	return out
+
+args = []
+i = 1
+while i < len(sys.argv):
+	if sys.argv[i] == '-z':
+		compressed = True
+	elif sys.argv[i] == '-a':
+		i = i + 1
+		base_address = int(sys.argv[i], 0)
+	else:
+		args.append(sys.argv[i])
+	i = i + 1
+if len(args) > 0:
+	input_file = args[0]
+if len(args) > 1:
+	output_file = args[1]
+
+ext = input_file.lower().rsplit('.', 1)[-1]
+if ext in ('hex', 'ihx'):
+	pieces, fills = read_hex(input_file)
+else:
+	pieces, fills = read_image(input_file, base_address)
+segments = split_runs(make_segments(pieces, fills))
+
+# The programmed data of all segments back to back
+binraw = bytearray()
+table = []
+for address, data, flags, value in segments:
+	if flags & SEG_SET:
+		crc = binascii.crc_hqx(struct.pack('<I', value) * (data // 4), 0xFFFF)
+		table.append((address, data // 4, 0, flags, crc, value))
+		print('0x%08x %6d bytes set to 0x%08x' % (address, data, value))
+	elif flags & SEG_FILL:
+		table.append((address, data // 4, 0, flags, 0, 0))
+		print('0x%08x %6d bytes fill' % (address, data))
 	else:
-		b0 = (binraw[i])
-		b1 = (binraw[i + 1])
-		b2 = (binraw[i + 2])
-		b3 = (binraw[i + 3])
-	tmp = b0 | (b1 << 8) | (b2 << 16) | (b3 << 24)
-	word_array.append(hex(tmp))
+		table.append((address, len(data) // 4, len(binraw) // 4, flags, binascii.crc_hqx(bytes(data), 0xFFFF), 0))
+		print('0x%08x %6d bytes' % (address, len(data)))
+		binraw.extend(data)
+if len(binraw) // 4 > 0xFFFF:
+	sys.exit("image too large")
+
+word_array = []
+for address, words in image.word_pieces(0, memoryview(bytes(binraw))):
+	word_array.extend(hex(w) for w in words)
 
 # print(word_array)
-ifile.close()
 
 ofile = open(output_file, mode = 'w')
+ofile.write("#define BIN_SEGMENTS %d\n" % len(table))
+ofile.write("SEGMENT code bin_segments[] = {\n")
+for address, words, offset, flags, crc, value in table:
+	ofile.write("{0x%08x,%d,%d,0x%02x,0x%04x,0x%x},\n" % (address, words, offset, flags, crc, value))
+ofile.write("};\n")
+if compressed:
+	lz = lz_compress(binraw)
+	if lz_decompress(lz, len(binraw)) != binraw:
+		sys.exit("LZ round trip failed")
+	print('%d bytes compressed to %d (%.1f%%)' % (len(binraw), len(lz), 100.0 * len(lz) / len(binraw)))
+	ofile.write("#define BINLZ_SIZE %d\n" % len(binraw))
+	ofile.write("U8 code binlz[] = {\n")
+	for i in range(0, len(lz)):
+		ofile.write(hex(lz[i]) + ',')
+		if (i % 16) == 15:
+			ofile.write("\n")
+	ofile.write("\n};")
+	ofile.close()
+	sys.exit(0)
 ofile.write("U32 code binraw[] = {\n")
 cnt = 0;
 for i in range(0, len(word_array)):
@@ -0,0 +1,515 @@
+
+"""
+GDB remote serial protocol server for SiM3 targets.
+
+	python gdb_server.py [-p port]
+	arm-none-eabi-gdb image.elf -ex "target extended-remote :3333"
+
+The server opens the first debug adapter (ADI_BACKEND=sim works too),
+halts the core and serves one GDB connection at a time.
+
+- g/G read or write all core registers in one batched transfer.
+- m/M/X go through a TargetMemory page cache, so a memory dump costs one
+  block read per 1 KB and writes are sent as bursts before the core runs.
+- Z0/Z1 use the Flash Patch and Breakpoint unit for code below 0x20000000.
+  Software breakpoints in SRAM patch a bkpt instruction into memory.
+- vFlashErase/vFlashWrite/vFlashDone erase pages and program flash
+  through FLASHCTRL with the batched DapSession queue.
+- "monitor reset" resets and halts the core.
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+import adi
+import si32FlashProgrammer as prog
+import target_memory
+from si32FlashProgrammer import DHCSR, DCRSR, DEMCR, AIRCR, DP_SELECT, MEMAP_BANK_0, \
+	MEMAP_CSW, MEMAP_TAR, MEMAP_DRW
+
+GDB_PORT = 3333
+
+# DHCSR
+DHCSR_KEY = 0xA05F0000
+DHCSR_C_DEBUGEN = 0x00000001
+DHCSR_C_HALT = 0x00000002
+DHCSR_C_STEP = 0x00000004
+DHCSR_C_MASKINTS = 0x00000008
+DHCSR_S_HALT = 0x00020000
+
+DCRSR_REGWNR = 0x00010000
+DEMCR_VC_CORERESET = 0x00000001
+
+# Flash Patch and Breakpoint unit
+FP_CTRL = 0xE0002000
+FP_COMP0 = 0xE0002008
+FP_CTRL_KEY_ENABLE = 0x00000003
+FP_COMP_ENABLE = 0x00000001
+FP_REPLACE_LOWER = 0x40000000
+FP_REPLACE_UPPER = 0x80000000
+FP_CODE_LIMIT = 0x20000000
+
+BKPT_INSTRUCTION = 0xBE00
+
+# r0-r12, sp, lr, pc, xpsr in DCRSR.REGSEL order
+NUM_REGS = 17
+
+# Seconds between DHCSR polls while the core runs
+RUN_POLL_INTERVAL = 0.01
+
+TARGET_XML = """<?xml version="1.0"?>
+<!DOCTYPE target SYSTEM "gdb-target.dtd">
+<target>
+<architecture>arm</architecture>
+<feature name="org.gnu.gdb.arm.m-profile">
+<reg name="r0" bitsize="32"/><reg name="r1" bitsize="32"/>
+<reg name="r2" bitsize="32"/><reg name="r3" bitsize="32"/>
+<reg name="r4" bitsize="32"/><reg name="r5" bitsize="32"/>
+<reg name="r6" bitsize="32"/><reg name="r7" bitsize="32"/>
+<reg name="r8" bitsize="32"/><reg name="r9" bitsize="32"/>
+<reg name="r10" bitsize="32"/><reg name="r11" bitsize="32"/>
+<reg name="r12" bitsize="32"/>
+<reg name="sp" bitsize="32" type="data_ptr"/>
+<reg name="lr" bitsize="32"/>
+<reg name="pc" bitsize="32" type="code_ptr"/>
+<reg name="xpsr" bitsize="32"/>
+</feature>
+</target>
+"""
+
+MEMORY_MAP_XML = """<?xml version="1.0"?>
+<!DOCTYPE memory-map PUBLIC "+//IDN gnu.org//DTD GDB Memory Map V1.0//EN" "http://sourceware.org/gdb/gdb-memory-map.dtd">
+<memory-map>
+<memory type="flash" start="0x%x" length="0x%x"><property name="blocksize">0x%x</property></memory>
+<memory type="ram" start="0x%x" length="0x%x"/>
+</memory-map>
+""" % (prog.FLASH_ADDR, target_memory.FLASH_SIZE, target_memory.PAGE_SIZE,
+	prog.SRAM_ADDR, target_memory.SRAM_SIZE)
+
+class GdbError(Exception):
+	pass
+
+#------------------------------------------------------------------------------
+# Core access
+#------------------------------------------------------------------------------
+
+class Core:
+	"""Run control, registers and breakpoints of the halted core."""
+
+	def __init__(self, uda):
+		self.uda = uda
+		self.mem = target_memory.TargetMemory(uda)
+		self.fpb = [None] * self.fpb_count()
+		self.soft = {}
+
+	def _raw(self):
+		# Batched transfers bypass the session queue and its cached state
+		self.uda.flush()
+		self.uda.invalidate()
+		return self.uda.uda
+
+	def fpb_count(self):
+		ctrl = prog.read_AHB(self.uda, FP_CTRL)
+		return ((ctrl >> 4) & 0xF) | ((ctrl >> 8) & 0x70)
+
+	def read_registers(self):
+		"""All NUM_REGS registers in one StartTransfers. DCRSR and DCRDR are
+		adjacent, so with auto increment each register costs three transfers."""
+		dev = self._raw()
+		dev.QueueWrite(DP_SELECT, MEMAP_BANK_0)
+		dev.QueueWrite(MEMAP_CSW, 0x23000012)
+		for n in range(NUM_REGS):
+			dev.QueueWrite(MEMAP_TAR, DCRSR)
+			dev.QueueWrite(MEMAP_DRW, n)
+			dev.QueueRead(MEMAP_DRW)
+		return dev.StartTransfers()
+
+	def write_registers(self, values):
+		dev = self._raw()
+		dev.QueueWrite(DP_SELECT, MEMAP_BANK_0)
+		dev.QueueWrite(MEMAP_CSW, 0x23000002)
+		for n, value in enumerate(values):
+			dev.QueueWrite(MEMAP_TAR, DCRSR + 4)
+			dev.QueueWrite(MEMAP_DRW, value)
+			dev.QueueWrite(MEMAP_TAR, DCRSR)
+			dev.QueueWrite(MEMAP_DRW, n | DCRSR_REGWNR)
+		dev.StartTransfers()
+
+	def read_register(self, n):
+		return prog.swd_read_core_register(self.uda, n)
+
+	def write_register(self, n, value):
+		prog.swd_write_core_register(self.uda, n, value)
+
+	def halted(self):
+		return bool(prog.read_AHB(self.uda, DHCSR) & DHCSR_S_HALT)
+
+	def halt(self):
+		prog.write_AHB(self.uda, DHCSR, DHCSR_KEY | DHCSR_C_HALT | DHCSR_C_DEBUGEN)
+		self.mem.invalidate()
+
+	def resume(self, step=False):
+		self.mem.flush()
+		# Steps run with interrupts masked. C_MASKINTS may only change while
+		# halted, then resume with it kept
+		run = DHCSR_KEY | DHCSR_C_DEBUGEN
+		if step:
+			run = run | DHCSR_C_MASKINTS
+		prog.write_AHB(self.uda, DHCSR, run | DHCSR_C_HALT)
+		if step:
+			run = run | DHCSR_C_STEP
+		prog.write_AHB(self.uda, DHCSR, run)
+		self.uda.flush()
+		self.mem.invalidate()
+
+	def reset_halt(self):
+		self.mem.flush()
+		prog.write_AHB(self.uda, DEMCR, DEMCR_VC_CORERESET)
+		prog.write_AHB(self.uda, AIRCR, 0x05FA0004)
+		self.uda.flush()
+		self.mem.invalidate()
+
+	#--------------------------------------------------------------------------
+	# Breakpoints
+	#--------------------------------------------------------------------------
+
+	def _fpb_comp(self, address):
+		replace = FP_REPLACE_UPPER if address & 2 else FP_REPLACE_LOWER
+		return (address & 0x1FFFFFFC) | replace | FP_COMP_ENABLE
+
+	def add_breakpoint(self, address, hardware):
+		if address < FP_CODE_LIMIT and None in self.fpb:
+			n = self.fpb.index(None)
+			self.fpb[n] = address
+			prog.write_AHB(self.uda, FP_CTRL, FP_CTRL_KEY_ENABLE)
+			prog.write_AHB(self.uda, FP_COMP0 + n * 4, self._fpb_comp(address))
+			return
+		region = self.mem.region(address)
+		if hardware or region is None or not region[2]:
+			raise GdbError('no breakpoint resource for 0x%08x' % address)
+		if address not in self.soft:
+			self.soft[address] = self.mem.read(address, 2)
+			self.mem.write(address, struct.pack('<H', BKPT_INSTRUCTION))
+
+	def remove_breakpoint(self, address):
+		if address in self.fpb:
+			n = self.fpb.index(address)
+			self.fpb[n] = None
+			prog.write_AHB(self.uda, FP_COMP0 + n * 4, 0)
+		elif address in self.soft:
+			self.mem.write(address, self.soft.pop(address))
+
+	def clear_breakpoints(self):
+		for address in [a for a in self.fpb if a is not None] + list(self.soft):
+			self.remove_breakpoint(address)
+		self.mem.flush()
+
+
+#------------------------------------------------------------------------------
+# RSP
+#------------------------------------------------------------------------------
+
+def checksum(data):
+	return sum(data) & 0xFF
+
+def escape(data):
+	"""Binary data as sent in X packets and qXfer replies."""
+	out = bytearray()
+	for b in data:
+		if b in b'#$}*':
+			out += bytes([0x7D, b ^ 0x20])
+		else:
+			out.append(b)
+	return bytes(out)
+
+def unescape(data):
+	out = bytearray()
+	it = iter(data)
+	for b in it:
+		out.append(next(it) ^ 0x20 if b == 0x7D else b)
+	return bytes(out)
+
+class GdbServer:
+	def __init__(self, core):
+		self.core = core
+		self.conn = None
+		self.ack = True
+		self.rx = b''
+		self.flash = {}
+
+	#--------------------------------------------------------------------------
+	# Packets
+	#--------------------------------------------------------------------------
+
+	def _recv(self):
+		data = self.conn.recv(4096)
+		if not data:
+			raise ConnectionError('gdb closed the connection')
+		self.rx += data
+
+	def read_packet(self):
+		"""Next packet payload, or b'\\x03' for an interrupt."""
+		while True:
+			start = self.rx.find(b'$')
+			if self.rx[:1] == b'\x03':
+				self.rx = self.rx[1:]
+				return b'\x03'
+			if start >= 0:
+				end = self.rx.find(b'#', start)
+				if end >= 0 and len(self.rx) >= end + 3:
+					payload = self.rx[start + 1:end]
+					sum_ok = int(self.rx[end + 1:end + 3], 16) == checksum(payload)
+					self.rx = self.rx[end + 3:]
+					if self.ack:
+						self.conn.sendall(b'+' if sum_ok else b'-')
+					if sum_ok:
+						return payload
+					continue
+				self.rx = self.rx[start:]
+			else:
+				self.rx = b''
+			self._recv()
+
+	def send_packet(self, payload):
+		if isinstance(payload, str):
+			payload = payload.encode()
+		packet = b'$' + payload + b'#%02x' % checksum(payload)
+		while True:
+			self.conn.sendall(packet)
+			if not self.ack:
+				return
+			while not self.rx:
+				self._recv()
+			reply, self.rx = self.rx[:1], self.rx[1:]
+			if reply != b'-':
+				return
+
+	def interrupted(self):
+		"""Checks for ^C without blocking while the core runs."""
+		self.conn.setblocking(False)
+		try:
+			self.rx += self.conn.recv(4096)
+		except BlockingIOError:
+			pass
+		finally:
+			self.conn.setblocking(True)
+		if b'\x03' in self.rx:
+			self.rx = self.rx.replace(b'\x03', b'', 1)
+			return True
+		return False
+
+	#--------------------------------------------------------------------------
+	# Commands
+	#--------------------------------------------------------------------------
+
+	def stop_reply(self):
+		return 'S05'
+
+	def wait_halt(self):
+		while not self.core.halted():
+			if self.interrupted():
+				self.core.halt()
+				return 'S02'
+			time.sleep(RUN_POLL_INTERVAL)
+		self.core.mem.invalidate()
+		return 'S05'
+
+	def xfer(self, document, offset, length):
+		chunk = document[offset:offset + length]
+		return (b'l' if offset + length >= len(document) else b'm') + escape(chunk)
+
+	def handle(self, packet):
+		cmd = packet[:1]
+		args = packet[1:].decode('latin-1')
+		core = self.core
+
+		if cmd == b'?':
+			return self.stop_reply()
+		if cmd == b'g':
+			return ''.join(struct.pack('<I', v).hex() for v in core.read_registers())
+		if cmd == b'G':
+			data = bytes.fromhex(args)
+			core.write_registers(struct.unpack('<%dI' % NUM_REGS, data[:NUM_REGS * 4]))
+			return 'OK'
+		if cmd == b'p':
+			n = int(args, 16)
+			if n >= NUM_REGS:
+				return 'E01'
+			return struct.pack('<I', core.read_register(n)).hex()
+		if cmd == b'P':
+			n, value = args.split('=')
+			core.write_register(int(n, 16), struct.unpack('<I', bytes.fromhex(value))[0])
+			return 'OK'
+		if cmd == b'm':
+			address, length = [int(x, 16) for x in args.split(',')]
+			return core.mem.read(address, length).hex()
+		if cmd == b'M':
+			where, data = args.split(':')
+			address, length = [int(x, 16) for x in where.split(',')]
+			core.mem.write(address, bytes.fromhex(data))
+			return 'OK'
+		if cmd == b'X':
+			where, data = packet[1:].split(b':', 1)
+			address, length = [int(x, 16) for x in where.decode().split(',')]
+			if length:
+				core.mem.write(address, unescape(data))
+			return 'OK'
+		if cmd in (b'c', b's'):
+			if args:
+				core.write_register(15, int(args, 16))
+			core.resume(step=(cmd == b's'))
+			return self.wait_halt()
+		if cmd in (b'Z', b'z'):
+			kind, address = args.split(',')[:2]
+			if kind not in ('0', '1'):
+				return ''
+			if cmd == b'Z':
+				core.add_breakpoint(int(address, 16), kind == '1')
+			else:
+				core.remove_breakpoint(int(address, 16))
+			return 'OK'
+		if cmd == b'H' or cmd == b'T':
+			return 'OK'
+		if cmd == b'D':
+			core.clear_breakpoints()
+			core.resume()
+			return 'OK'
+		if cmd == b'k':
+			return None
+		if cmd == b'q':
+			return self.query(args)
+		if cmd == b'Q':
+			if args == 'StartNoAckMode':
+				self.send_packet('OK')
+				self.ack = False
+				return None
+			return ''
+		if cmd == b'v':
+			return self.v_command(packet)
+		return ''
+
+	def query(self, args):
+		if args.startswith('Supported'):
+			return 'PacketSize=4000;QStartNoAckMode+;qXfer:features:read+;qXfer:memory-map:read+'
+		if args.startswith('Xfer:features:read:target.xml:'):
+			offset, length = [int(x, 16) for x in args.split(':')[-1].split(',')]
+			return self.xfer(TARGET_XML.encode(), offset, length)
+		if args.startswith('Xfer:memory-map:read::'):
+			offset, length = [int(x, 16) for x in args.split(':')[-1].split(',')]
+			return self.xfer(MEMORY_MAP_XML.encode(), offset, length)
+		if args == 'Attached':
+			return '1'
+		if args == 'C':
+			return 'QC1'
+		if args == 'fThreadInfo':
+			return 'm1'
+		if args == 'sThreadInfo':
+			return 'l'
+		if args.startswith('Rcmd,'):
+			command = bytes.fromhex(args[5:]).decode()
+			if command.strip() in ('reset', 'reset halt'):
+				self.core.reset_halt()
+				return 'OK'
+			return ('unknown monitor command\n').encode().hex()
+		return ''
+
+	def v_command(self, packet):
+		if packet.startswith(b'vFlashErase:'):
+			address, length = [int(x, 16) for x in packet[12:].decode().split(',')]
+			page = target_memory.PAGE_SIZE
+			for base in range(address & ~(page - 1), address + length, page):
+				prog.erase_page(self.core.uda, base)
+			return 'OK'
+		if packet.startswith(b'vFlashWrite:'):
+			where, data = packet[12:].split(b':', 1)
+			self.flash[int(where, 16)] = unescape(data)
+			return 'OK'
+		if packet.startswith(b'vFlashDone'):
+			self.flash_done()
+			return 'OK'
+		if packet.startswith(b'vMustReplyEmpty'):
+			return ''
+		if packet.startswith(b'vCont?'):
+			return ''
+		return ''
+
+	def flash_done(self):
+		"""Program the collected vFlashWrite blocks, adjacent ones merged."""
+		runs = []
+		for address in sorted(self.flash):
+			data = self.flash[address]
+			if runs and runs[-1][0] + len(runs[-1][1]) == address:
+				runs[-1][1].extend(data)
+			else:
+				runs.append((address, bytearray(data)))
+		self.flash = {}
+		for address, data in runs:
+			# Whole words, padded with the erased value
+			lead = address & 3
+			data = b'\xff' * lead + data + b'\xff' * (-(lead + len(data)) % 4)
+			words = struct.unpack('<%dI' % (len(data) // 4), data)
+			prog.write_sequential_words(self.core.uda, address - lead, words, len(words))
+		self.core.mem.invalidate()
+
+	def serve(self, conn):
+		self.conn = conn
+		self.ack = True
+		self.rx = b''
+		while True:
+			packet = self.read_packet()
+			if packet == b'\x03':
+				self.core.halt()
+				self.send_packet('S02')
+				continue
+			try:
+				reply = self.handle(packet)
+				# Deferred DAP writes fail on the packet that queued them
+				self.core.uda.flush()
+			except (adi.AdiError, target_memory.TargetMemoryError, GdbError, ValueError, struct.error):
+				reply = 'E01'
+			if reply is None:
+				if packet[:1] == b'k':
+					return
+				continue
+			self.send_packet(reply)
+
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser(description='GDB server for SiM3 targets.')
+	parser.add_argument('-p', '--port', type=int, default=GDB_PORT)
+	args = parser.parse_args()
+
+	uda = prog.DapSession(adi.AdiDevice())
+	uda.Open()
+	uda.ConnectSWD()
+	uda.LineReset()
+	prog.write_DAP(uda, MEMAP_BANK_0, prog.DP_CTRLSTAT, 0x50000000)
+	prog.write_AHB(uda, DHCSR, DHCSR_KEY | DHCSR_C_HALT | DHCSR_C_DEBUGEN)
+	prog.enable_flashctrl_clock(uda)
+
+	server = GdbServer(Core(uda))
+	listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+	listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+	listener.bind(('localhost', args.port))
+	listener.listen(1)
+	print('Waiting for gdb on port %d' % args.port)
+	try:
+		while True:
+			conn, peer = listener.accept()
+			conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+			print('gdb connected from %s:%d' % peer)
+			try:
+				server.serve(conn)
+			except ConnectionError:
+				pass
+			conn.close()
+			print('gdb disconnected')
+	except KeyboardInterrupt:
+		pass
+	finally:
+		listener.close()
+		prog.write_DAP(uda, MEMAP_BANK_0, prog.DP_CTRLSTAT, 0x00000000)
+		uda.Disconnect()
+		uda.Close()
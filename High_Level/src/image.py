@@ -0,0 +1,145 @@
+
+"""
+Image loading for the host tools.
+
+A .bin or ELF file is memory mapped and its loadable data is viewed as
+little endian 32-bit words without copying. Only the tail of a piece that
+is not a whole number of words is copied, into one zero padded word.
+
+	with Image("sim3u1xx_USBHID_ram.bin") as img:
+		for address, words in img.words():
+			swd_write_mem(uda, address, words)
+
+The views point into the mapping and keep it alive after close().
+"""
+
+import mmap
+import os
+import struct
+import sys
+from array import array
+
+# Load address of a flat .bin
+SRAM_ADDR = 0x20000000
+
+PT_LOAD = 1
+
+# memoryview.cast('I') uses the host byte order
+HOST_LITTLE_ENDIAN = sys.byteorder == 'little'
+
+class ImageError(Exception):
+	pass
+
+def padded_word(data, lead=0):
+	"""Up to four bytes as one word in an array, zero padded on both sides."""
+
+	word = array('I', bytes(lead) + bytes(data) + bytes(4 - lead - len(data)))
+	if not HOST_LITTLE_ENDIAN:
+		word.byteswap()
+	return word
+
+def word_pieces(address, data):
+	"""Split a byte view into (address, words) pieces: the whole words as a
+	view cast to 32-bit words, and a partial first or last word as one zero
+	padded word."""
+
+	pieces = []
+	lead = address & 3
+	if lead:
+		pieces.append((address - lead, padded_word(data[:4 - lead], lead)))
+		data = data[4 - lead:]
+		address = address - lead + 4
+	n = len(data) & ~3
+	if n:
+		if HOST_LITTLE_ENDIAN:
+			words = data[:n].cast('I')
+		else:
+			words = array('I', bytes(data[:n]))
+			words.byteswap()
+		pieces.append((address, words))
+	if len(data) > n:
+		pieces.append((address + n, padded_word(data[n:])))
+	return pieces
+
+def elf_segments(view):
+	"""PT_LOAD program headers of a 32-bit little endian ELF, returns
+	(segments, fills). Data goes to the load address like objcopy -O binary,
+	and the part of a segment beyond its file size (.bss) is a fill of
+	(address, bytes)."""
+
+	if bytes(view[0:4]) != b'\x7fELF' or view[4] != 1 or view[5] != 1:
+		raise ImageError("not a 32-bit little endian ELF file")
+	hdr = struct.unpack_from('<16sHHIIIIIHHHHHH', view, 0)
+	phoff, phentsize, phnum = hdr[5], hdr[9], hdr[10]
+	segments = []
+	fills = []
+	for i in range(phnum):
+		p_type, p_offset, p_vaddr, p_paddr, p_filesz, p_memsz, p_flags, p_align = \
+			struct.unpack_from('<IIIIIIII', view, phoff + i * phentsize)
+		if p_type != PT_LOAD:
+			continue
+		if p_filesz:
+			segments.append((p_paddr, view[p_offset:p_offset + p_filesz]))
+		if p_memsz > p_filesz:
+			fills.append((p_vaddr + p_filesz, p_memsz - p_filesz))
+	return segments, fills
+
+class Image:
+	"""A memory mapped .bin or ELF file.
+
+	segments is a list of (address, bytes view) and fills a list of
+	(address, length) for zero initialized memory (ELF only).
+	"""
+
+	def __init__(self, filename, address=SRAM_ADDR):
+		self.file = open(filename, mode='rb')
+		if os.fstat(self.file.fileno()).st_size:
+			self.map = mmap.mmap(self.file.fileno(), 0, access=mmap.ACCESS_READ)
+		else:
+			self.map = None
+		self.view = memoryview(self.map if self.map is not None else b'')
+		if bytes(self.view[0:4]) == b'\x7fELF':
+			self.segments, self.fills = elf_segments(self.view)
+		else:
+			self.segments, self.fills = [(address, self.view)], []
+
+	def __enter__(self):
+		return self
+
+	def __exit__(self, *args):
+		self.close()
+
+	def close(self):
+		self.segments = []
+		self.view.release()
+		if self.map is not None:
+			try:
+				self.map.close()
+			except BufferError:
+				# Word views are still alive, the mapping goes with the last one
+				pass
+		self.file.close()
+
+	def words(self):
+		"""All loadable data as (address, 32-bit word view) pieces."""
+		pieces = []
+		for address, data in self.segments:
+			pieces.extend(word_pieces(address, data))
+		return pieces
+
+	def fill_words(self):
+		"""The fills as (address, word count). The load data was padded with
+		zeros up to the next word already, so a fill starts at the word after
+		its first byte."""
+		fills = []
+		for address, length in self.fills:
+			start = (address + 3) & ~3
+			end = (address + length + 3) & ~3
+			if end > start:
+				fills.append((start, (end - start) // 4))
+		return fills
+
+	@property
+	def size(self):
+		"""Bytes of loadable data."""
+		return sum(len(data) for address, data in self.segments)
@@ -0,0 +1,208 @@
+
+"""
+Phase timing for the programming flow.
+
+Phases are timed with the monotonic clock and kept as records:
+
+	{"source": "host", "run": "1729340000-4242", "tag": "SIM0000",
+	 "phase": "erase", "start_us": 1200, "us": 35400}
+
+start_us counts from the start of the run, tag names the board (set with
+tagged() by a worker that drives one adapter). The adapter firmware built
+with PHASE_TIMING sends the same records with "source": "adapter" over
+UART0, timed by its Timer3 tick.
+
+	with phase_timing.phase('verify'):
+		...
+
+	@phase_timing.timed('cycle')
+	def program_board(serial, filename):
+
+Time the steps of a flow, not the memory primitives it calls: the records
+are kept in memory until the run ends, so a phase inside a loop of a long
+running tool grows without bound.
+
+When PHASE_TIMING_LOG names a file the records of a run are appended to it
+at exit as JSON lines. Running this module aggregates such logs into per
+phase percentiles and a histogram:
+
+Usage: python phase_timing.py [-c] log.jsonl [...]
+"""
+
+import atexit
+import contextlib
+import functools
+import json
+import os
+import sys
+import threading
+import time
+
+# Percentiles in the report
+PERCENTILES = (50, 90, 99)
+
+# Histogram bar length of the most populated bucket
+BAR_WIDTH = 40
+
+class Recorder:
+	"""Collects the phase records of one run. Safe to use from threads."""
+
+	def __init__(self, source='host'):
+		self.source = source
+		self.run = '%d-%d' % (time.time(), os.getpid())
+		self.origin = time.monotonic()
+		self.records = []
+		self.lock = threading.Lock()
+		self.local = threading.local()
+
+	@property
+	def tag(self):
+		return getattr(self.local, 'tag', '')
+
+	def add(self, name, start, seconds, tag=None):
+		"""Record a phase that began at monotonic time start."""
+		record = {'source': self.source, 'run': self.run,
+			'tag': self.tag if tag is None else tag, 'phase': name,
+			'start_us': int((start - self.origin) * 1e6), 'us': int(seconds * 1e6)}
+		with self.lock:
+			self.records.append(record)
+		return record
+
+	@contextlib.contextmanager
+	def phase(self, name):
+		start = time.monotonic()
+		try:
+			yield
+		finally:
+			self.add(name, start, time.monotonic() - start)
+
+	@contextlib.contextmanager
+	def tagged(self, tag):
+		"""Tag the records of this thread, normally with the adapter serial."""
+		old = self.tag
+		self.local.tag = tag
+		try:
+			yield
+		finally:
+			self.local.tag = old
+
+	def timed(self, name):
+		"""Decorator recording every call of a function as phase name."""
+		def wrap(fn):
+			@functools.wraps(fn)
+			def timed_fn(*args, **kwargs):
+				with self.phase(name):
+					return fn(*args, **kwargs)
+			return timed_fn
+		return wrap
+
+	def save(self, filename):
+		"""Append the records to a JSON lines file and forget them."""
+		with self.lock:
+			records, self.records = self.records, []
+		if records:
+			with open(filename, 'a') as f:
+				for record in records:
+					f.write(json.dumps(record) + '\n')
+
+recorder = Recorder()
+phase = recorder.phase
+tagged = recorder.tagged
+timed = recorder.timed
+
+if os.environ.get('PHASE_TIMING_LOG'):
+	atexit.register(lambda: recorder.save(os.environ['PHASE_TIMING_LOG']))
+
+
+#------------------------------------------------------------------------------
+# Report
+#------------------------------------------------------------------------------
+
+def load(filenames):
+	"""Records from JSON lines files, other lines are skipped."""
+
+	records = []
+	for filename in filenames:
+		with open(filename) as f:
+			for line in f:
+				line = line.strip()
+				if not line.startswith('{'):
+					continue
+				try:
+					record = json.loads(line)
+				except ValueError:
+					continue
+				if 'phase' in record and 'us' in record:
+					records.append(record)
+	return records
+
+def percentile(values, p):
+	"""Nearest rank percentile of sorted values."""
+	rank = max(1, -(-len(values) * p // 100))
+	return values[rank - 1]
+
+def group(records):
+	"""Durations in us by (source, phase), in order of first appearance."""
+	phases = {}
+	for record in records:
+		phases.setdefault((record.get('source', 'host'), record['phase']), []).append(record['us'])
+	for values in phases.values():
+		values.sort()
+	return phases
+
+def histogram(values):
+	"""Counts per power of two bucket of us, as [(low, high, count)]."""
+	buckets = {}
+	for v in values:
+		b = max(v, 1).bit_length() - 1
+		buckets[b] = buckets.get(b, 0) + 1
+	return [(1 << b, (1 << (b + 1)) - 1, buckets.get(b, 0))
+		for b in range(min(buckets), max(buckets) + 1)]
+
+def format_us(us):
+	if us >= 1000000:
+		return '%.2fs' % (us / 1e6)
+	if us >= 1000:
+		return '%.1fms' % (us / 1e3)
+	return '%dus' % us
+
+def report(records, out=sys.stdout, csv=False, histograms=True):
+	phases = group(records)
+	if csv:
+		out.write('source,phase,count,total_us,mean_us,' +
+			','.join('p%d_us' % p for p in PERCENTILES) + ',max_us\n')
+		for (source, name), values in phases.items():
+			out.write('%s,%s,%d,%d,%d,' % (source, name, len(values), sum(values),
+				sum(values) // len(values)) +
+				','.join('%d' % percentile(values, p) for p in PERCENTILES) +
+				',%d\n' % values[-1])
+		return
+
+	runs = len(set(r.get('run') for r in records))
+	out.write('%d records from %d runs\n\n' % (len(records), runs))
+	out.write('%-8s %-22s %6s %10s' % ('source', 'phase', 'count', 'total') +
+		''.join('%10s' % ('p%d' % p) for p in PERCENTILES) + '%10s\n' % 'max')
+	for (source, name), values in sorted(phases.items(), key=lambda kv: -sum(kv[1])):
+		out.write('%-8s %-22s %6d %10s' % (source, name, len(values), format_us(sum(values))) +
+			''.join('%10s' % format_us(percentile(values, p)) for p in PERCENTILES) +
+			'%10s\n' % format_us(values[-1]))
+
+	if not histograms:
+		return
+	for (source, name), values in phases.items():
+		out.write('\n%s %s\n' % (source, name))
+		buckets = histogram(values)
+		peak = max(count for low, high, count in buckets)
+		for low, high, count in buckets:
+			out.write('  %9s - %-9s %6d %s\n' % (format_us(low), format_us(high), count,
+				'#' * (count * BAR_WIDTH // peak)))
+
+
+if __name__ == "__main__":
+	args = sys.argv[1:]
+	csv = '-c' in args
+	files = [a for a in args if a != '-c']
+	if not files:
+		print(__doc__.strip().splitlines()[-1])
+		sys.exit(1)
+	report(load(files), csv=csv)
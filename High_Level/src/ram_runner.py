@@ -0,0 +1,204 @@
+
+"""
+Load-and-go runner for short test and calibration programs in target SRAM.
+
+A test is a function in a RAM image. The runner loads the image, or skips
+the load when the same image is still resident, passes up to four
+arguments in r0-r3 and optionally a mailbox block in SRAM, calls the
+function with LR pointing at a breakpoint and waits for the core to halt.
+The return value (r0) and the mailbox contents are then read back.
+
+	runner = RamRunner(uda)
+	runner.load(SRAM_ADDR, image_words)
+	r0, block = runner.call(entry, (10, 20), mailbox=[0] * 8, result_words=8)
+
+With a mailbox its address is passed as the first argument, so the target
+side is simply
+	int test(U32 *mailbox, int a, int b);
+
+The core must be connected and halted (connect_and_halt_core) first.
+"""
+
+import time
+
+import si32FlashProgrammer as prog
+from si32FlashProgrammer import DHCSR, DCRSR, DCRDR, DP_SELECT, MEMAP_BANK_0, \
+	MEMAP_CSW, MEMAP_TAR, MEMAP_DRW, SRAM_ADDR
+
+# Core register numbers (DCRSR.REGSEL)
+REG_R0 = 0
+REG_SP = 13
+REG_LR = 14
+REG_PC = 15
+REG_XPSR = 16
+
+# DHCSR bits
+DHCSR_KEY = 0xA05F0000
+DHCSR_C_DEBUGEN = 0x00000001
+DHCSR_C_HALT = 0x00000002
+DHCSR_C_MASKINTS = 0x00000008
+DHCSR_S_HALT = 0x00020000
+
+DCRSR_REGWNR = 0x00010000
+XPSR_T = 0x01000000
+
+# bkpt #0, bkpt #0 - the called function returns here
+BKPT_WORD = 0xBE00BE00
+
+# The top 256 bytes of SRAM are reserved for the runner: the mailbox, then
+# the breakpoint word in the last word. The stack grows down from below.
+SRAM_TOP = SRAM_ADDR + 0x8000
+MAILBOX_ADDR = SRAM_TOP - 0x100
+MAILBOX_WORDS = 63
+BKPT_ADDR = SRAM_TOP - 4
+STACK_TOP = MAILBOX_ADDR
+
+# Default limits for one call
+CALL_TIMEOUT = 1.0
+POLL_LIMIT = 100000
+
+class RunnerError(Exception):
+	pass
+
+class RamRunner:
+	"""Calls functions in target SRAM and collects their results."""
+
+	def __init__(self, uda, stack_top=STACK_TOP, mailbox_addr=MAILBOX_ADDR, bkpt_addr=BKPT_ADDR):
+		self.uda = uda
+		self.stack_top = stack_top
+		self.mailbox_addr = mailbox_addr
+		self.bkpt_addr = bkpt_addr
+		self.resident = None
+		self.bkpt_loaded = False
+		self.halt_pc = None
+		self.polls = 0
+		self.last_time = 0.0
+
+	def load(self, address, words, force=False):
+		"""Write an image unless the same one is still resident.
+		Returns True if the image was written.
+
+		:param words: image as a sequence of 32-bit words
+		"""
+		key = (address, len(words), hash(tuple(words)))
+		if not force and self.resident == key:
+			# Cheap check that nothing overwrote it since
+			head = list(words[:4])
+			if list(prog.swd_read_mem(self.uda, address, len(head))) == head:
+				return False
+		prog.swd_write_mem(self.uda, address, words, len(words))
+		self.resident = key
+		self.bkpt_loaded = False
+		return True
+
+	def write_core_registers(self, regs):
+		"""Write (n, value) pairs to core registers in one batch."""
+		self.uda.QueueWrite(DP_SELECT, MEMAP_BANK_0)
+		self.uda.QueueWrite(MEMAP_CSW, 0x23000002)
+		for n, value in regs:
+			self.uda.QueueWrite(MEMAP_TAR, DCRDR)
+			self.uda.QueueWrite(MEMAP_DRW, value & 0xFFFFFFFF)
+			self.uda.QueueWrite(MEMAP_TAR, DCRSR)
+			self.uda.QueueWrite(MEMAP_DRW, n | DCRSR_REGWNR)
+		self.uda.StartTransfers()
+
+	def wait_halt(self, timeout=CALL_TIMEOUT, poll_limit=POLL_LIMIT):
+		"""Poll DHCSR until the core halts. Returns False on timeout."""
+		deadline = time.monotonic() + timeout
+		for self.polls in range(1, poll_limit + 1):
+			if prog.read_AHB(self.uda, DHCSR) & DHCSR_S_HALT:
+				return True
+			if time.monotonic() > deadline:
+				break
+		return False
+
+	def halt(self):
+		prog.write_AHB(self.uda, DHCSR, DHCSR_KEY | DHCSR_C_DEBUGEN | DHCSR_C_HALT)
+
+	def call(self, entry, args=(), mailbox=None, result_words=0, timeout=CALL_TIMEOUT,
+			mask_interrupts=True):
+		"""Call the function at entry and wait for it to return.
+		Returns (r0, list of result_words mailbox words).
+
+		:param entry: function address, the Thumb bit is added
+		:param args: up to four argument words for r0-r3
+		:param mailbox: words written to the mailbox before the call; its
+		 address is then passed in r0 and args move up by one
+		:param result_words: mailbox words to read back after the call
+		:param timeout: seconds to wait for the breakpoint
+		"""
+		start = time.perf_counter()
+		args = list(args)
+		if mailbox is not None or result_words:
+			if mailbox:
+				if len(mailbox) > MAILBOX_WORDS:
+					raise RunnerError('mailbox too large')
+				prog.swd_write_mem(self.uda, self.mailbox_addr, mailbox, len(mailbox))
+			args.insert(0, self.mailbox_addr)
+		if len(args) > 4:
+			raise RunnerError('at most four register arguments')
+		if not self.bkpt_loaded:
+			prog.swd_write_mem(self.uda, self.bkpt_addr, [BKPT_WORD], 1)
+			self.bkpt_loaded = True
+
+		regs = [(n, args[n]) for n in range(len(args))]
+		regs += [(REG_SP, self.stack_top), (REG_LR, self.bkpt_addr | 1),
+			(REG_PC, entry & ~1), (REG_XPSR, XPSR_T)]
+		self.write_core_registers(regs)
+
+		# C_MASKINTS may only change while halted, then resume with it kept
+		run = DHCSR_KEY | DHCSR_C_DEBUGEN
+		if mask_interrupts:
+			run = run | DHCSR_C_MASKINTS
+			prog.write_AHB(self.uda, DHCSR, run | DHCSR_C_HALT)
+		prog.write_AHB(self.uda, DHCSR, run)
+
+		if not self.wait_halt(timeout):
+			self.halt()
+			self.halt_pc = prog.swd_read_core_register(self.uda, REG_PC)
+			raise RunnerError('no breakpoint within %.3f s, PC = 0x%08x' % (timeout, self.halt_pc))
+
+		self.halt_pc = prog.swd_read_core_register(self.uda, REG_PC)
+		result = prog.swd_read_core_register(self.uda, REG_R0)
+		block = []
+		if result_words:
+			block = list(prog.swd_read_mem(self.uda, self.mailbox_addr, result_words))
+		self.last_time = time.perf_counter() - start
+		return result, block
+
+	@property
+	def returned(self):
+		"""True if the last call halted on the return breakpoint rather
+		than a breakpoint inside the test."""
+		return self.halt_pc is not None and (self.halt_pc & ~3) == self.bkpt_addr
+
+
+if __name__ == "__main__":
+	import adi
+	import struct
+	import sys
+
+	if len(sys.argv) < 3:
+		sys.exit('usage: python ram_runner.py <image.bin> <entry> [args...]')
+	with open(sys.argv[1], mode='rb') as f:
+		binraw = f.read()
+	binraw = binraw + bytes(-len(binraw) % 4)
+	words = list(struct.unpack('<%dI' % (len(binraw) // 4), binraw))
+	entry = int(sys.argv[2], 0)
+	args = [int(a, 0) for a in sys.argv[3:]]
+
+	uda = adi.AdiDevice()
+	uda.Open()
+	try:
+		uda.ConnectSWD()
+		uda.LineReset()
+		prog.write_DAP(uda, MEMAP_BANK_0, prog.DP_CTRLSTAT, 0x50000000)
+		prog.connect_and_halt_core(uda)
+
+		runner = RamRunner(uda)
+		runner.load(SRAM_ADDR, words)
+		result, block = runner.call(entry, args)
+		print('r0 = 0x%08x, halted at 0x%08x, %.1f ms' % (result, runner.halt_pc, runner.last_time * 1000))
+	finally:
+		prog.write_DAP(uda, MEMAP_BANK_0, prog.DP_CTRLSTAT, 0x00000000)
+		uda.Close()
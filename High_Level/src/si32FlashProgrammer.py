@@ -10,10 +10,20 @@
 This example Python script uses the Silicon Labs USB Debug Adapter to erase,
 program, or read SiM3 on-chip flash.  The goal is to demonstrate the required
 debug port and device register sequences for each of these operations.
+
+Each phase of the demo flow below is timed, see phase_timing.py. Set
+PHASE_TIMING_LOG to collect the records of every run in one file. The flash
+and memory functions themselves record nothing, they are also called in
+loops by long running tools (gdb_server.py, station.py).
 """
 
 import adi
+import csv
+import image
+import phase_timing
 import sys
+import time
+from array import array
 
 #------------------------------------------------------------------------------
 # DAP Constants
@@ -63,6 +73,16 @@ CHIPAP_ID = 0x0D
 # SRAM and Flash address
 SRAM_ADDR = 0x20000000
 FLASH_ADDR = 0
+
+# SiM3U1x7 flash size and erase page size
+FLASH_SIZE = 0x40000
+FLASH_PAGE_SIZE = 0x400
+
+# Largest RepeatRead/RepeatWrite passed to the adapter in one call
+ADI_MAX_REPEAT_WORDS = 256
+
+# TAR auto increment is only guaranteed within a 1 KB block
+TAR_BLOCK_SIZE = 0x400
 #------------------------------------------------------------------------------
 # FLASHCTRL Register Definitions
 #------------------------------------------------------------------------------
@@ -95,6 +115,13 @@ MASK_FLASH_CONFIG_ERASE_ENABLE = 0x00040000     # 0 - Enable flash writes
 MASK_FLASH_CONFIG_SEQUENTIAL = 0x00010000       # 0 - Independent flash writes
 												# 1 - Sequential double-buffered flash writes
 
+# Erased flash reads back as all ones
+VALUE_FLASH_ERASED = 0xFFFFFFFF
+
+# Runs of erased words at least this long are skipped when writing flash.
+# Moving the write address costs about as many transfers as writing 6 words.
+FLASH_SKIP_MIN_WORDS = 6
+
 # FLASH.KEY Masks
 MASK_FLASH_KEY_KEY = 0x000000FF                 # Write 0xA5, 0xF1 to unlock the next flash write/erase
 												# Write 0xA5, 0xF2 to unlock all flash writes/erases
@@ -144,10 +171,12 @@ def write_DAP(uda, select, address, data):
 
 def read_AHB(uda, address):
 	"""Use MEMAP to read one 32-bit word on the AHB bus.
+	The MEMAP is left in auto increment mode, so on a DapSession an access
+	to the next word does not set TAR again.
 	:param address: AHB address to read
 	"""
 	uda.QueueWrite(DP_SELECT, MEMAP_BANK_0)
-	uda.QueueWrite(MEMAP_CSW, 0x23000002)
+	uda.QueueWrite(MEMAP_CSW, 0x23000012)
 	uda.QueueWrite(MEMAP_TAR, address)
 	uda.QueueRead(MEMAP_DRW)
 	return uda.StartTransfers()[0]
@@ -158,12 +187,138 @@ def write_AHB(uda, address, data):
 	:param data: 32-bit value to write
 	"""
 	uda.QueueWrite(DP_SELECT, MEMAP_BANK_0)
-	uda.QueueWrite(MEMAP_CSW, 0x23000002)
+	uda.QueueWrite(MEMAP_CSW, 0x23000012)
 	uda.QueueWrite(MEMAP_TAR, address)
 	uda.QueueWrite(MEMAP_DRW, data)
 	uda.StartTransfers()
 
 
+#------------------------------------------------------------------------------
+# DAP Session
+#------------------------------------------------------------------------------
+
+# Queued transfers sent in one StartTransfers at most
+SESSION_MAX_QUEUE = 64
+
+class DapSession:
+	"""
+	Wraps an AdiDevice and drops writes of SELECT, MEMAP CSW and MEMAP TAR
+	that would not change them. TAR is followed through auto incremented DRW
+	accesses within a 1 KB block.
+
+	StartTransfers only goes to the adapter when a read result is needed
+	(or SESSION_MAX_QUEUE transfers are queued), so write-only sequences are
+	coalesced into one batch. Reads sent early because the queue filled up
+	are kept and returned by the next StartTransfers, ahead of the later
+	ones. Errors of deferred writes therefore show up at a later call. Any other adapter call (LineReset, Disconnect, ...) sends
+	the queue first and forgets the cached state.
+
+		uda = DapSession(adi.AdiDevice())
+	"""
+
+	def __init__(self, uda):
+		self.uda = uda
+		self.queue = []
+		self.reads = 0
+		self.pending = []
+		self.invalidate()
+
+	def __getattr__(self, name):
+		attr = getattr(self.uda, name)
+		if not callable(attr):
+			return attr
+		def call(*args, **kwargs):
+			self.flush()
+			self.invalidate()
+			return attr(*args, **kwargs)
+		return call
+
+	def invalidate(self):
+		"""Forget SELECT, CSW and TAR, for example after a line reset."""
+		self.select = None
+		self.csw = None
+		self.tar = None
+
+	def _memap(self):
+		return self.select is not None and (self.select & 0xFF0000F0) == MEMAP_BANK_0
+
+	def _drw_access(self, count=1):
+		# Follow TAR through the MEMAP auto increment, which wraps in 1 KB
+		if self.tar is None or self.csw is None:
+			return
+		if self.csw & 0x37 == 0x12:
+			tar = self.tar + 4 * count
+			self.tar = tar if tar >> 10 == self.tar >> 10 else None
+		elif self.csw & 0x30:
+			self.tar = None
+
+	def QueueWrite(self, address, data):
+		if address == DP_SELECT:
+			if data == self.select:
+				return
+			self.select = data
+		elif address & 0x01 and self._memap():
+			if address == MEMAP_CSW:
+				if data == self.csw:
+					return
+				self.csw = data
+			elif address == MEMAP_TAR:
+				if data == self.tar:
+					return
+				self.tar = data
+			elif address == MEMAP_DRW:
+				self._drw_access()
+		self.queue.append((address, data))
+		if len(self.queue) >= SESSION_MAX_QUEUE:
+			self.pending = self.flush()
+
+	def QueueRead(self, address):
+		if address & 0x01 and self._memap() and address == MEMAP_DRW:
+			self._drw_access()
+		self.queue.append((address, None))
+		self.reads += 1
+		if len(self.queue) >= SESSION_MAX_QUEUE:
+			self.pending = self.flush()
+
+	def StartTransfers(self):
+		"""Returns the reads queued since the last call, or [] without
+		talking to the adapter when only writes are queued."""
+		if not self.reads and not self.pending:
+			return []
+		return self.flush()
+
+	def flush(self):
+		"""Send everything queued, returns the read results, those of
+		earlier sends of a full queue first."""
+		results, self.pending = self.pending, []
+		if not self.queue:
+			return results
+		queue, self.queue = self.queue, []
+		self.reads = 0
+		for address, data in queue:
+			if data is None:
+				self.uda.QueueRead(address)
+			else:
+				self.uda.QueueWrite(address, data)
+		try:
+			return results + list(self.uda.StartTransfers())
+		except adi.AdiError:
+			self.invalidate()
+			raise
+
+	def RepeatRead(self, count=1, address=MEMAP_DRW, buffer=None):
+		self.flush()
+		if address == MEMAP_DRW and self._memap():
+			self._drw_access(count)
+		return self.uda.RepeatRead(count, address, buffer)
+
+	def RepeatWrite(self, data, address=MEMAP_DRW):
+		self.flush()
+		if address == MEMAP_DRW and self._memap():
+			self._drw_access(len(word_view(data)))
+		self.uda.RepeatWrite(data, address)
+
+
 #------------------------------------------------------------------------------
 # Flash Programming Functions
 #------------------------------------------------------------------------------
@@ -204,6 +359,13 @@ def device_erase(uda):
 	write_DAP(uda, CHIPAP_BANK_0, CHIPAP_CTRL1, 0x0)    # CTRL1.sysreset_req_ap = 0
 
 
+def wait_flash_idle(uda):
+	"""Wait for the flash busy bit to clear."""
+
+	flash_config = read_AHB(uda, FLASHCTRL_BASE_ADDRESS + OFF_FLASH_CONFIG)
+	while flash_config & MASK_FLASH_CONFIG_BUSY:
+		flash_config = read_AHB(uda, FLASHCTRL_BASE_ADDRESS + OFF_FLASH_CONFIG)
+
 def write_sequential_words(uda, address, data_words, length):
 	"""Write words in an array (list) to flash.
 	Clocks must already be enabled and the device must be halted."""
@@ -239,67 +401,105 @@ def write_sequential_words(uda, address, data_words, length):
 	# interface for each 16 bits of data, which is very slow and inefficient.  In an actual
 	# programmer implementation, this process should write data to the serial wire debug port
 	# as efficiently and quickly as possible.
-	for x in range (0, length):
+	x = 0
+	while x < length:
+
+		# A flash write can only clear bits, so writing the erased value
+		# changes nothing. Skip long runs of it by moving the write address.
+		run = x
+		while run < length and data_words[run] == VALUE_FLASH_ERASED:
+			run = run + 1
+		if run - x >= FLASH_SKIP_MIN_WORDS or run == length:
+			x = run
+			if x < length:
+				wait_flash_idle(uda)
+				write_AHB(uda, FLASHCTRL_BASE_ADDRESS + OFF_FLASH_WRITE_ADDRESS, address + x * 4)
+				uda.QueueWrite(MEMAP_CSW, 0x23000002)
+				uda.QueueWrite(MEMAP_TAR, FLASHCTRL_BASE_ADDRESS + OFF_FLASH_WRITE_DATA)
+				uda.StartTransfers()
+			continue
 
 		# Writes are 16-bits
 		uda.QueueWrite(MEMAP_DRW, 0x0000FFFF & data_words[x])
 		uda.QueueWrite(MEMAP_DRW, (0xFFFF0000 & data_words[x]) >> 16)
 		uda.StartTransfers()
+		x = x + 1
 
 	# Clean up after the write operations
 
+	# Let the last sequential write finish before locking
+	wait_flash_idle(uda)
+
 	# Lock flash writes/erases
 	write_AHB(uda, FLASHCTRL_BASE_ADDRESS + OFF_FLASH_WRITE_KEY, 0x5A)
 
 
 def read_sequential_words(uda, address, length):
-	"""Read words in an array (list) from flash.
+	"""Read words in an array (array('I')) from flash.
 	The device must already be halted."""
 
-	data_words = []
-
-	# Auto increment addresses
-	uda.QueueWrite(DP_SELECT, MEMAP_BANK_0)
-	uda.QueueWrite(MEMAP_CSW, 0x23000012)
-	uda.QueueWrite(MEMAP_TAR, address)
-
-	# length is given in word addresses, so translate these to device
-	# addresses in bytes
-	for x in range (0, length):
-		uda.QueueRead(MEMAP_DRW)
-		data_words.append(uda.StartTransfers()[0])
-
-	return data_words
+	return swd_read_mem(uda, address, length)
+
+def word_view(data):
+	"""Return data as a sequence of 32-bit words. Lists and tuples are
+	returned as they are, buffers (bytes, bytearray, array('I')) as a
+	memoryview of little endian words without copying."""
+
+	if isinstance(data, (list, tuple)):
+		return data
+	view = memoryview(data).cast('B')
+	if len(view) % 4:
+		# Pad the tail to a whole word
+		view = memoryview(bytes(view) + bytes(-len(view) % 4))
+	return view.cast('I')
+
+def mem_chunks(address, length):
+	"""Split a transfer of length words into (word offset, count) chunks
+	no larger than the adapter allows and not crossing a 1 KB TAR block."""
+
+	x = 0
+	while x < length:
+		block = (TAR_BLOCK_SIZE - ((address + x * 4) & (TAR_BLOCK_SIZE - 1))) // 4
+		count = min(length - x, ADI_MAX_REPEAT_WORDS, block)
+		yield x, count
+		x = x + count
+
+def swd_write_mem(uda, address, data_ws, length=None):
+	"""Write words to SRAM.
+	Clocks must already be enabled and the device must be halted.
+
+	:param data_ws: list of words, or bytes/array('I') of little endian words
+	:param length: number of words to write, all of data_ws by default
+	"""
 
-def swd_write_mem(uda, address, data_ws, length):
-	"""Write ws in an array (list) to SRAM.
-	Clocks must already be enabled and the device must be halted."""
+	data_ws = word_view(data_ws)
+	if length is None:
+		length = len(data_ws)
 
 	# Auto increment addresses
 	uda.QueueWrite(DP_SELECT, MEMAP_BANK_0)
 	uda.QueueWrite(MEMAP_CSW, 0x23000012)
 
-	uda.QueueWrite(MEMAP_TAR, address)
-	for x in range (0, length):
-		uda.QueueWrite(MEMAP_DRW, data_ws[x])
+	for x, count in mem_chunks(address, length):
+		uda.QueueWrite(MEMAP_TAR, address + x * 4)
 		uda.StartTransfers()
+		uda.RepeatWrite(data_ws[x:x + count], MEMAP_DRW)
 
 def swd_read_mem(uda, address, length):
-	"""Read words in an array (list) from SRAM.
+	"""Read words from SRAM into an array('I').
 	The device must already be halted."""
 
-	data_words = []
+	data_words = array('I', bytes(length * 4))
+	view = memoryview(data_words)
 
 	# Auto increment addresses
 	uda.QueueWrite(DP_SELECT, MEMAP_BANK_0)
 	uda.QueueWrite(MEMAP_CSW, 0x23000012)
-	uda.QueueWrite(MEMAP_TAR, address)
 
-	# length is given in word addresses, so translate these to device
-	# addresses in bytes
-	for x in range (0, length):
-		uda.QueueRead(MEMAP_DRW)
-		data_words.append(uda.StartTransfers()[0])
+	for x, count in mem_chunks(address, length):
+		uda.QueueWrite(MEMAP_TAR, address + x * 4)
+		uda.StartTransfers()
+		uda.RepeatRead(count, MEMAP_DRW, view[x:x + count])
 
 	return data_words
 
@@ -352,9 +552,7 @@ def erase_page(uda, address):
 	write_AHB(uda, FLASHCTRL_BASE_ADDRESS + OFF_FLASH_WRITE_DATA, 0x00)
 
 	# Wait for the flash busy bit to clear
-	flash_config = read_AHB(uda, FLASHCTRL_BASE_ADDRESS + OFF_FLASH_CONFIG)
-	while flash_config & MASK_FLASH_CONFIG_BUSY:
-		flash_config = read_AHB(uda, FLASHCTRL_BASE_ADDRESS + OFF_FLASH_CONFIG)
+	wait_flash_idle(uda)
 
 	# Clean up after the erase
 
@@ -364,48 +562,194 @@ def erase_page(uda, address):
 	# Lock flash writes/erases
 	write_AHB(uda, FLASHCTRL_BASE_ADDRESS + OFF_FLASH_WRITE_KEY, 0x5A)
 
+#------------------------------------------------------------------------------
+# Erase Planning
+#------------------------------------------------------------------------------
+
+class EraseCosts:
+	"""
+	Cost model of the erase plans. The defaults are rough figures for the
+	USB Debug Adapter; bench.py measures them for a setup:
+
+		costs = EraseCosts.from_bench('bench.csv')
+
+	:param page_erase: seconds per erase_page, link overhead included
+	:param mass_erase: seconds of device_erase
+	:param read_rate: bytes/s reading flash back to save a page
+	:param program_rate: bytes/s of write_sequential_words restoring it
+	"""
+
+	def __init__(self, page_erase=0.025, mass_erase=0.1, read_rate=100000, program_rate=20000):
+		self.page_erase = page_erase
+		self.mass_erase = mass_erase
+		self.read_rate = read_rate
+		self.program_rate = program_rate
+
+	@classmethod
+	def from_bench(cls, filename, backend='dll'):
+		"""Costs from the flash rows of a bench.py CSV file."""
+
+		costs = cls()
+		with open(filename) as f:
+			rows = list(csv.DictReader(f))
+		for row in rows:
+			if row.get('backend') != backend or row.get('ok') != '1':
+				continue
+			operation, seconds, size = row['operation'], float(row['seconds']), int(row['bytes'])
+			if operation == 'flash_erase_page':
+				costs.page_erase = seconds * FLASH_PAGE_SIZE / size
+			elif operation == 'flash_erase_mass':
+				costs.mass_erase = seconds
+			elif operation == 'flash_program' and row['mode'] == 'word':
+				costs.program_rate = size / seconds
+			elif operation == 'flash_verify' and row['chunk_bytes'] == str(TAR_BLOCK_SIZE):
+				costs.read_rate = size / seconds
+		return costs
+
+	def page_plan(self, pages):
+		return len(pages) * self.page_erase
+
+	def mass_plan(self, restore):
+		size = len(restore) * FLASH_PAGE_SIZE
+		return self.mass_erase + size / self.read_rate + size / self.program_rate
+
+class ErasePlan:
+	"""
+	How to erase flash before programming an image.
+
+	mode is 'none' (nothing in flash), 'page' (erase_page for each page in
+	pages) or 'mass' (device_erase, after saving the preserved pages in
+	restore and writing them back afterwards). predicted holds the seconds
+	of every mode considered, actual the seconds run() took.
+	"""
+
+	def __init__(self, mode, pages, restore, predicted):
+		self.mode = mode
+		self.pages = pages
+		self.restore = restore
+		self.predicted = predicted
+		self.actual = None
+
+	def __str__(self):
+		if self.mode == 'none':
+			return 'no flash erase'
+		if self.mode == 'page':
+			text = 'page erase of %d page%s' % (len(self.pages), 's'[len(self.pages) == 1:])
+		else:
+			text = 'mass erase, %d page%s preserved' % (len(self.restore), 's'[len(self.restore) == 1:])
+		others = ['%s %s' % (mode, phase_timing.format_us(int(seconds * 1e6)))
+			for mode, seconds in sorted(self.predicted.items()) if mode != self.mode]
+		if others:
+			text += ' (%s)' % ', '.join(others)
+		return text
+
+	def report(self):
+		"""The plan with its predicted and actual time."""
+
+		text = '%s: predicted %s' % (self, phase_timing.format_us(int(self.predicted.get(self.mode, 0) * 1e6)))
+		if self.actual is not None:
+			text += ', actual %s' % phase_timing.format_us(int(self.actual * 1e6))
+		return text
+
+	def run(self, uda):
+		"""Erase. Clocks must already be enabled and the device must be
+		halted, it is halted again after a mass erase."""
+
+		start = time.monotonic()
+		if self.mode == 'page':
+			for address in self.pages:
+				erase_page(uda, address)
+		elif self.mode == 'mass':
+			saved = [(address, swd_read_mem(uda, address, FLASH_PAGE_SIZE // 4)) for address in self.restore]
+			device_erase(uda)
+			# The Chip_AP erase resets the device
+			connect_and_halt_core(uda)
+			enable_flashctrl_clock(uda)
+			for address, words in saved:
+				if any(w != VALUE_FLASH_ERASED for w in words):
+					write_sequential_words(uda, address, words, len(words))
+		if isinstance(uda, DapSession):
+			uda.flush()
+		self.actual = time.monotonic() - start
+
+def flash_pages(address, length):
+	"""Base addresses of the flash pages a range touches."""
+
+	first = address & ~(FLASH_PAGE_SIZE - 1)
+	return list(range(first, address + length, FLASH_PAGE_SIZE))
+
+def plan_erase(segments, preserve=(), costs=None, mode=None):
+	"""
+	Choose the cheapest erase that leaves the flash an image needs erased
+	and the preserved ranges intact.
+
+	:param segments: an image.Image or a list of (address, data); pieces
+	 outside flash (SRAM) need no erase
+	:param preserve: (start, end) address ranges of user data to keep, a
+	 page erase never touches them and a mass erase writes them back
+	:param mode: 'page' or 'mass' to force a plan, else the cheaper one
+	:return: ErasePlan
+	"""
+
+	costs = costs or EraseCosts()
+	segments = getattr(segments, 'segments', segments)
+	flash_end = FLASH_ADDR + FLASH_SIZE
+
+	pages = set()
+	for address, data in segments:
+		end = address + len(data)
+		if end <= FLASH_ADDR or address >= flash_end or not len(data):
+			continue
+		if address < FLASH_ADDR or end > flash_end:
+			raise ValueError('segment 0x%08x-0x%08x crosses the flash boundary' % (address, end - 1))
+		pages.update(flash_pages(address, len(data)))
+
+	kept = set()
+	for start, end in preserve:
+		start, end = max(start, FLASH_ADDR), min(end, flash_end)
+		if start < end:
+			kept.update(flash_pages(start, end - start))
+	overlap = pages & kept
+	if overlap:
+		raise ValueError('the image overlaps preserved page 0x%08x' % min(overlap))
+
+	pages, kept = sorted(pages), sorted(kept)
+	if not pages:
+		return ErasePlan('none', [], [], {'none': 0})
+	predicted = {'page': costs.page_plan(pages), 'mass': costs.mass_plan(kept)}
+	if mode is None:
+		mode = 'mass' if predicted['mass'] < predicted['page'] else 'page'
+	elif mode not in predicted:
+		raise ValueError('unknown erase mode %r' % mode)
+	return ErasePlan(mode, pages if mode == 'page' else [], kept if mode == 'mass' else [], predicted)
+
 def sram_programming(uda):
 	filename = "sim3u1xx_Blinky.bin"
 	# filename = "sim3u1xx_USBHID_ram.bin"
 	print(sys.version_info)
-	data = []
-	f = open(filename,mode = 'rb')
-	binraw = f.read()
-	for i in range(0, len(binraw), 4):
-		if (sys.version_info < (3, 0, 0)):
-			b0 = ord(binraw[i])
-			b1 = ord(binraw[i + 1])
-			b2 = ord(binraw[i + 2])
-			b3 = ord(binraw[i + 3])
-		else:
-			b0 = (binraw[i])
-			b1 = (binraw[i + 1])
-			b2 = (binraw[i + 2])
-			b3 = (binraw[i + 3])
-		tmp = b0 | (b1 << 8) | (b2 << 16) | (b3 << 24)
-		data.append(tmp)
-	# print(','.join(hex(x) for x in data))
-	f.close()
+	img = image.Image(filename, SRAM_ADDR)
+	pieces = img.words()
 	# Start programing firmware into SRAM
-	size = int(len(binraw) / 4)
-	print('Size is %d'%size)
-	recv = []
-	for i in range(0, size, 1024):
-		if (i + 1024) < size:
-			count = 1024
-		else:
-			count = size - i
-
-		print('Offset = %d'%(count+i))
-		swd_write_mem(uda, SRAM_ADDR + i * 4, data[i:], count)
-		recv[i:] = swd_read_mem(uda, SRAM_ADDR + i * 4, count)
-
+	print('Size is %d'%(img.size // 4))
 	error = 0
-	for i in range (0, size):
-		if recv[i] != data[i]:
-			error = error + 1
-			if error < 100:
-				print('0x%x, %d'%(recv[i], i))
+	for address, words in pieces:
+		print('Offset = %d'%((address - SRAM_ADDR) // 4 + len(words)))
+		with phase_timing.phase('sram_write'):
+			swd_write_mem(uda, address, words)
+		with phase_timing.phase('verify'):
+			recv = swd_read_mem(uda, address, len(words))
+		if recv == words:
+			continue
+		for i in range (0, len(words)):
+			if recv[i] != words[i]:
+				error = error + 1
+				if error < 100:
+					print('0x%x, %d'%(recv[i], (address - SRAM_ADDR) // 4 + i))
+
+	# Zero .bss of an ELF image, so its startup may skip the clear
+	for address, count in img.fill_words():
+		with phase_timing.phase('sram_write'):
+			swd_write_mem(uda, address, [0] * count)
 
 	if error == 0:
 		print('Data verified!')
@@ -413,100 +757,112 @@ def sram_programming(uda):
 		print('%d error happens'%error)
 
 	# reset vector entry address
-	rst_isr = (data[1] & 0xFFFFFFFE)
+	vectors = pieces[0][1]
+	rst_isr = (vectors[1] & 0xFFFFFFFE)
+	sp = vectors[0]
 	# print(hex(rst_isr))
-	data[0] = 0x20000000
-	# update vector table and PC
-	swd_write_mem(uda, 0xe000ed08, data, 1)
-	# recv = swd_read_core_register(uda, 15)
-	swd_write_core_register(uda, 15, rst_isr)
-	recv = swd_read_core_register(uda, 15)
-	# print(hex(recv))
-
-	data[0] = 0x20008000
-	swd_write_core_register(uda, 13, data[0])
-	write_AHB(uda, DHCSR, 0xA05F0000)
-	tmp = read_AHB(uda, DHCSR)
+	img.close()
+	with phase_timing.phase('run'):
+		# update vector table and PC
+		swd_write_mem(uda, 0xe000ed08, [SRAM_ADDR], 1)
+		# recv = swd_read_core_register(uda, 15)
+		swd_write_core_register(uda, 15, rst_isr)
+		recv = swd_read_core_register(uda, 15)
+		# print(hex(recv))
+
+		swd_write_core_register(uda, 13, sp)
+		write_AHB(uda, DHCSR, 0xA05F0000)
+		tmp = read_AHB(uda, DHCSR)
 	# print(hex(tmp))
 
 
 #------------------------------------------------------------------------------
 # The Application
 #------------------------------------------------------------------------------
-# Open the first available debug adapter
-uda = adi.AdiDevice()
-uda.Open()
-
-# Connect using Serial Wire and enable debug features
-uda.ConnectSWD()
-uda.LineReset()
-write_DAP(uda, MEMAP_BANK_0, DP_CTRLSTAT, 0x50000000)
-
-# connect_and_halt_core(uda)
-
-# Bulk erase the entire user flash
-print('Erasing all flash in the device...')
-device_erase(uda)
-print('done!')
-
-connect_and_halt_core(uda)
-
-# Clocks must be enabled to the flash controller to write/erase flash
-enable_flashctrl_clock(uda)
-
-# Write a set of halfwords to two pages
-print('\nWriting test data to addresses 0x00000200 and 0x00000400...', end='')
-write_data_words = [0xA5A50000, 0x88885A5A, 0x1111FFEE, 0x11FFEEEE]
-write_sequential_words(uda, 0x00000200, write_data_words, 4)
-write_data_words.reverse()
-write_sequential_words(uda, 0x00000400, write_data_words, 4)
-print(' done!')
-
-# Read the data from flash
-print('\nReading test data to address 0x00000200...', end='')
-write_data_words.reverse()
-read_data_words = read_sequential_words(uda, 0x00000200, 4)
-if set(write_data_words) & set(read_data_words):
-	print(' data verified!')
-else:
-	print(' error in data!')
-print('Write: [', ', '.join([hex(i) for i in write_data_words]), ']')
-print('Read: [', ', '.join([hex(i) for i in read_data_words]), ']')
-
-print('\nReading test data to address 0x00000400...', end='')
-write_data_words.reverse()
-read_data_words = read_sequential_words(uda, 0x00000400, 4)
-if set(write_data_words) & set(read_data_words):
-	print(' data verified!')
-else:
-	print(' error in data!')
-print('Write: [', ', '.join([hex(i) for i in write_data_words]), ']')
-print('Read: [', ', '.join([hex(i) for i in read_data_words]), ']')
-
-# Erase the 0x00001000 page of flash
-print('\nErasing page 0x00000200...', end='')
-erase_page(uda, 0x00000200)
-print(' done!')
-
-# Read the data from flash
-print('\nReading test data to address 0x00000200...', end='')
-data_words = [0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF]
-read_data_words = read_sequential_words(uda, 0x00000200, 4)
-if set(data_words) & set(read_data_words):
-	print(' data verified!')
-else:
-	print(' error in data!')
-print('Erased data: [', ', '.join([hex(i) for i in data_words]), ']')
-print('Read: [', ', '.join([hex(i) for i in read_data_words]), ']')
-
-# SRAM programming test
-print('\nStart SRAM programming')
-sram_programming(uda)
-print('\nSRAM programming done')
-
-
-# Disable debug and disconnect before exiting
-write_DAP(uda, MEMAP_BANK_0, DP_CTRLSTAT, 0x00000000)
-uda.Disconnect()
-uda.Close()
+if __name__ == "__main__":
+	# Open the first available debug adapter
+	uda = DapSession(adi.AdiDevice())
+	with phase_timing.phase('connect'):
+		uda.Open()
+
+		# Connect using Serial Wire and enable debug features
+		uda.ConnectSWD()
+		uda.LineReset()
+		write_DAP(uda, MEMAP_BANK_0, DP_CTRLSTAT, 0x50000000)
+
+	with phase_timing.phase('halt'):
+		connect_and_halt_core(uda)
+
+		# Clocks must be enabled to the flash controller to write/erase flash
+		enable_flashctrl_clock(uda)
+
+	# Erase the pages of the test data, or all user flash if that is cheaper
+	plan = plan_erase([(0x00000200, bytes(16)), (0x00000400, bytes(16))])
+	print('Erasing flash: %s...' % plan)
+	with phase_timing.phase('erase'):
+		plan.run(uda)
+	print(plan.report())
+
+	# Write a set of halfwords to two pages
+	print('\nWriting test data to addresses 0x00000200 and 0x00000400...', end='')
+	write_data_words = [0xA5A50000, 0x88885A5A, 0x1111FFEE, 0x11FFEEEE]
+	with phase_timing.phase('flash_write'):
+		write_sequential_words(uda, 0x00000200, write_data_words, 4)
+		write_data_words.reverse()
+		write_sequential_words(uda, 0x00000400, write_data_words, 4)
+	print(' done!')
+
+	# Read the data from flash
+	print('\nReading test data to address 0x00000200...', end='')
+	write_data_words.reverse()
+	with phase_timing.phase('flash_read'):
+		read_data_words = read_sequential_words(uda, 0x00000200, 4)
+	if set(write_data_words) & set(read_data_words):
+		print(' data verified!')
+	else:
+		print(' error in data!')
+	print('Write: [', ', '.join([hex(i) for i in write_data_words]), ']')
+	print('Read: [', ', '.join([hex(i) for i in read_data_words]), ']')
+
+	print('\nReading test data to address 0x00000400...', end='')
+	write_data_words.reverse()
+	with phase_timing.phase('flash_read'):
+		read_data_words = read_sequential_words(uda, 0x00000400, 4)
+	if set(write_data_words) & set(read_data_words):
+		print(' data verified!')
+	else:
+		print(' error in data!')
+	print('Write: [', ', '.join([hex(i) for i in write_data_words]), ']')
+	print('Read: [', ', '.join([hex(i) for i in read_data_words]), ']')
+
+	# Erase the 0x00001000 page of flash
+	print('\nErasing page 0x00000200...', end='')
+	with phase_timing.phase('erase_page'):
+		erase_page(uda, 0x00000200)
+	print(' done!')
+
+	# Read the data from flash
+	print('\nReading test data to address 0x00000200...', end='')
+	data_words = [0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF]
+	with phase_timing.phase('flash_read'):
+		read_data_words = read_sequential_words(uda, 0x00000200, 4)
+	if set(data_words) & set(read_data_words):
+		print(' data verified!')
+	else:
+		print(' error in data!')
+	print('Erased data: [', ', '.join([hex(i) for i in data_words]), ']')
+	print('Read: [', ', '.join([hex(i) for i in read_data_words]), ']')
+
+	# SRAM programming test
+	print('\nStart SRAM programming')
+	sram_programming(uda)
+	print('\nSRAM programming done')
+
+
+	# Disable debug and disconnect before exiting
+	write_DAP(uda, MEMAP_BANK_0, DP_CTRLSTAT, 0x00000000)
+	uda.Disconnect()
+	uda.Close()
 
+	print('')
+	phase_timing.report(phase_timing.recorder.records, histograms=False)
@@ -0,0 +1,565 @@
+
+"""
+Simulated SiM3 target and debug adapter for the 'sim' backend of adi.py.
+
+SimTarget models what the host scripts touch through the DAP: the SW-DP,
+the Cortex-M3 MEM-AP with its 1 KB TAR auto-increment window, the SiLabs
+Chip_AP, SRAM, flash behind the FLASHCTRL registers, the core debug
+registers (DHCSR, DCRSR, DCRDR) and the FPB comparators. Other peripheral
+registers just hold the last value written.
+
+SimTransport has the queue semantics of SLAB_ADI: QueueRead/QueueWrite
+only queue, StartTransfers, RepeatRead and RepeatWrite each cost one round
+trip. It counts round trips and transfers and adds up a virtual transfer
+time from a simple latency model, so host code can be benchmarked without
+an adapter:
+
+    ADI_BACKEND=sim python si32FlashProgrammer.py
+
+Code running on the core is modelled by hooks. A Python function registered
+for an address runs when the core is resumed with the PC there; it returns
+to LR and the core halts again if LR points at a bkpt or an FPB
+breakpoint. A single step (DHCSR.C_STEP) runs such a hook as one step and
+otherwise moves the PC on by one 16 bit instruction.
+
+    def add(target):
+        return target.regs[0] + target.regs[1]
+    target.hooks[0x20000101] = add
+"""
+
+import array
+import sys
+
+SRAM_ADDR = 0x20000000
+SRAM_SIZE = 0x8000
+FLASH_ADDR = 0
+FLASH_SIZE = 0x40000
+FLASH_PAGE_SIZE = 0x400
+
+# Debug port
+DP_IDCODE_VALUE = 0x2BA01477
+CHIPAP_ID_VALUE = 0x2430002
+CHIPAP_APSEL = 0x0A
+
+# Chip_AP CTRL1 bits
+CHIPAP_CTRL1_USER_ERASE = 0x1
+CHIPAP_CTRL1_SYSRESET_REQ = 0x4
+CHIPAP_CTRL1_CORE_RESET = 0x8
+
+# MEM-AP CSW.ADDR_INC and CSW.SIZE
+CSW_ADDR_INC = 0x30
+CSW_SIZE = 0x07
+CSW_SIZE_32_BITS = 0x02
+
+# Core debug registers
+DHCSR = 0xE000EDF0
+DCRSR = 0xE000EDF4
+DCRDR = 0xE000EDF8
+DHCSR_KEY = 0xA05F0000
+DHCSR_C_HALT = 0x00000002
+DHCSR_C_STEP = 0x00000004
+DHCSR_S_REGRDY = 0x00010000
+DHCSR_S_HALT = 0x00020000
+DCRSR_REGWNR = 0x00010000
+REG_LR = 14
+REG_PC = 15
+
+# bkpt instruction in either half of a word
+BKPT_HALFWORD = 0xBE00
+
+# Flash Patch and Breakpoint unit
+FP_CTRL = 0xE0002000
+FP_COMP0 = 0xE0002008
+FP_NUM_CODE = 6
+FP_CTRL_ENABLE = 0x1
+FP_CTRL_KEY = 0x2
+FP_COMP_ENABLE = 0x1
+
+# FLASHCTRL
+FLASHCTRL_BASE_ADDRESS = 0x4002E000
+OFF_FLASH_CONFIG = 0x00
+OFF_FLASH_CONFIG_SET = 0x04
+OFF_FLASH_CONFIG_CLR = 0x08
+OFF_FLASH_WRITE_ADDRESS = 0xA0
+OFF_FLASH_WRITE_DATA = 0xB0
+OFF_FLASH_WRITE_KEY = 0xC0
+MASK_FLASH_CONFIG_ERASE_ENABLE = 0x00040000
+MASK_FLASH_CONFIG_SEQUENTIAL = 0x00010000
+
+# Default latency model: USB HID round trip and time per DAP transfer
+ROUND_TRIP_TIME = 0.002
+TRANSFER_TIME = 0.000004
+
+
+def _error(status):
+    import adi
+    return adi.AdiError(status)
+
+
+class SimTarget:
+    """One SiM3 device with its debug port."""
+
+    def __init__(self, flash_size=FLASH_SIZE, sram_size=SRAM_SIZE):
+        self.sram = bytearray(sram_size)
+        self.flash = bytearray(b'\xff' * flash_size)
+        self._sram_words = memoryview(self.sram).cast('I')
+        self._flash_words = memoryview(self.flash).cast('I')
+        self.regs = [0] * 21
+        self.hooks = {}
+        self.periph = {}
+        self.reset()
+
+    def reset(self):
+        """Power-on state of the debug port and the core."""
+        self.select = 0
+        self.ctrlstat = 0
+        self.csw = 0
+        self.tar = 0
+        self.chipap_ctrl1 = 0
+        self.dhcsr = 0
+        self.dcrdr = 0
+        self.halted = True
+        self.flash_config = 0
+        self.flash_address = 0
+        self.flash_key = 0
+        self.flash_unlocked = 0
+        self.fp_ctrl = 0
+        self.fp_comp = [0] * FP_NUM_CODE
+
+    #--------------------------------------------------------------------------
+    # Memory
+    #--------------------------------------------------------------------------
+
+    def read32(self, address):
+        if SRAM_ADDR <= address < SRAM_ADDR + len(self.sram):
+            return self._sram_words[(address - SRAM_ADDR) >> 2]
+        if FLASH_ADDR <= address < FLASH_ADDR + len(self.flash):
+            return self._flash_words[(address - FLASH_ADDR) >> 2]
+        if address == DHCSR:
+            status = DHCSR_S_REGRDY | (self.dhcsr & 0xFFFF)
+            if self.halted:
+                status |= DHCSR_S_HALT
+            return status
+        if address == DCRDR:
+            return self.dcrdr
+        if FLASHCTRL_BASE_ADDRESS <= address < FLASHCTRL_BASE_ADDRESS + 0x100:
+            return self._flashctrl_read(address - FLASHCTRL_BASE_ADDRESS)
+        if address == FP_CTRL:
+            return (FP_NUM_CODE << 4) | self.fp_ctrl
+        if FP_COMP0 <= address < FP_COMP0 + 4 * FP_NUM_CODE:
+            return self.fp_comp[(address - FP_COMP0) >> 2]
+        if address >= 0x40000000:
+            return self.periph.get(address, 0)
+        # 0x83 : "ADI_STATUS_HWIF_TRANSFER_ERROR"
+        raise _error(0x83)
+
+    def write32(self, address, value):
+        if SRAM_ADDR <= address < SRAM_ADDR + len(self.sram):
+            self._sram_words[(address - SRAM_ADDR) >> 2] = value
+        elif FLASH_ADDR <= address < FLASH_ADDR + len(self.flash):
+            # Flash is only written through FLASHCTRL
+            pass
+        elif address == DHCSR:
+            self._write_dhcsr(value)
+        elif address == DCRSR:
+            if value & DCRSR_REGWNR:
+                self.regs[value & 0x1F] = self.dcrdr
+            else:
+                self.dcrdr = self.regs[value & 0x1F]
+        elif address == DCRDR:
+            self.dcrdr = value
+        elif FLASHCTRL_BASE_ADDRESS <= address < FLASHCTRL_BASE_ADDRESS + 0x100:
+            self._flashctrl_write(address - FLASHCTRL_BASE_ADDRESS, value)
+        elif address == FP_CTRL:
+            if value & FP_CTRL_KEY:
+                self.fp_ctrl = value & FP_CTRL_ENABLE
+        elif FP_COMP0 <= address < FP_COMP0 + 4 * FP_NUM_CODE:
+            self.fp_comp[(address - FP_COMP0) >> 2] = value
+        elif address >= 0x40000000:
+            self.periph[address] = value
+        else:
+            raise _error(0x83)
+
+    def read_words(self, address, count):
+        """Returns count words from address as array('I')."""
+        return array.array('I', [self.read32(address + x * 4) for x in range(count)])
+
+    def write_words(self, address, words):
+        for x, word in enumerate(words):
+            self.write32(address + x * 4, word)
+
+    #--------------------------------------------------------------------------
+    # Flash controller
+    #--------------------------------------------------------------------------
+
+    def _flashctrl_read(self, offset):
+        if offset == OFF_FLASH_CONFIG:
+            # Writes and erases complete at once, BUSY never reads set
+            return self.flash_config
+        if offset == OFF_FLASH_WRITE_ADDRESS:
+            return self.flash_address
+        return 0
+
+    def _flashctrl_write(self, offset, value):
+        if offset in (OFF_FLASH_CONFIG, OFF_FLASH_CONFIG_SET, OFF_FLASH_CONFIG_CLR):
+            if offset == OFF_FLASH_CONFIG_SET:
+                value = self.flash_config | value
+            elif offset == OFF_FLASH_CONFIG_CLR:
+                value = self.flash_config & ~value
+            self.flash_config = value
+        elif offset == OFF_FLASH_WRITE_ADDRESS:
+            self.flash_address = value
+        elif offset == OFF_FLASH_WRITE_KEY:
+            value &= 0xFF
+            if self.flash_key == 0xA5 and value in (0xF1, 0xF2):
+                # 0xF1 unlocks one write, 0xF2 until relocked
+                self.flash_unlocked = 1 if value == 0xF1 else -1
+            elif value != 0xA5:
+                self.flash_unlocked = 0
+            self.flash_key = value
+        elif offset == OFF_FLASH_WRITE_DATA:
+            self._flash_data(value)
+
+    def _flash_data(self, value):
+        if not self.flash_unlocked:
+            return
+        if self.flash_unlocked > 0:
+            self.flash_unlocked = 0
+        address = self.flash_address - FLASH_ADDR
+        if self.flash_config & MASK_FLASH_CONFIG_ERASE_ENABLE:
+            page = address & ~(FLASH_PAGE_SIZE - 1)
+            if 0 <= page < len(self.flash):
+                self.flash[page:page + FLASH_PAGE_SIZE] = b'\xff' * FLASH_PAGE_SIZE
+            return
+        if 0 <= address < len(self.flash) - 1:
+            # A write can only clear bits
+            self.flash[address] &= value & 0xFF
+            self.flash[address + 1] &= (value >> 8) & 0xFF
+        if self.flash_config & MASK_FLASH_CONFIG_SEQUENTIAL:
+            self.flash_address += 2
+
+    def erase_flash(self):
+        self.flash[:] = b'\xff' * len(self.flash)
+
+    #--------------------------------------------------------------------------
+    # Core
+    #--------------------------------------------------------------------------
+
+    def _write_dhcsr(self, value):
+        if (value & 0xFFFF0000) != DHCSR_KEY:
+            return
+        self.dhcsr = value & 0xFFFF
+        if value & DHCSR_C_HALT:
+            self.halted = True
+        elif value & DHCSR_C_STEP and self.halted:
+            self.step()
+        elif self.halted:
+            self.resume()
+
+    def _call_hook(self):
+        # Runs the hook at the PC and returns to LR, False without a hook
+        hook = self.hooks.get(self.regs[REG_PC] | 1) or self.hooks.get(self.regs[REG_PC] & ~1)
+        if hook is None:
+            return False
+        result = hook(self)
+        if result is not None:
+            self.regs[0] = result & 0xFFFFFFFF
+        self.regs[REG_PC] = self.regs[REG_LR] & ~1
+        return True
+
+    def breakpoint_at(self, pc):
+        """True if a bkpt instruction or an FPB comparator matches pc."""
+        if self.fp_ctrl & FP_CTRL_ENABLE:
+            replace = 0x80000000 if pc & 2 else 0x40000000
+            for comp in self.fp_comp:
+                if comp & FP_COMP_ENABLE and comp & 0x1FFFFFFC == pc & 0x1FFFFFFC \
+                        and comp & 0xC0000000 in (replace, 0xC0000000):
+                    return True
+        try:
+            word = self.read32(pc & ~3)
+        except Exception:
+            return False
+        if pc & 2:
+            word >>= 16
+        return (word & 0xFF00) == BKPT_HALFWORD
+
+    def resume(self):
+        """Runs the hook at the PC, if any, then returns to LR."""
+        self.halted = False
+        if self._call_hook() and self.breakpoint_at(self.regs[REG_PC]):
+            self.halted = True
+
+    def step(self):
+        """A hook runs as one step (like stepping over a call), anything
+        else is taken as a 16 bit instruction."""
+        if not self._call_hook():
+            self.regs[REG_PC] = (self.regs[REG_PC] + 2) & 0xFFFFFFFF
+
+    #--------------------------------------------------------------------------
+    # Debug port
+    #--------------------------------------------------------------------------
+
+    def _next_tar(self):
+        # The MEM-AP only increments within a 1 KB block
+        if self.csw & CSW_ADDR_INC:
+            step = 1 << (self.csw & CSW_SIZE)
+            self.tar = (self.tar & ~0x3FF) | ((self.tar + step) & 0x3FF)
+
+    def _write_drw(self, data):
+        size = self.csw & CSW_SIZE
+        if size == CSW_SIZE_32_BITS:
+            self.write32(self.tar, data)
+            return
+        # Byte and halfword accesses only change their lanes of the word
+        address = self.tar & ~3
+        mask = ((1 << (8 << size)) - 1) << ((self.tar & 3) * 8)
+        self.write32(address, (self.read32(address) & ~mask) | (data & mask))
+
+    def dap_write(self, address, data):
+        if not address & 0x01:
+            if address == 0x08:
+                self.select = data
+            elif address == 0x04:
+                self.ctrlstat = data
+            return
+        apsel = self.select >> 24
+        reg = (self.select & 0xF0) | (address & 0x0C)
+        if apsel == CHIPAP_APSEL:
+            if reg == 0x00:
+                if data & CHIPAP_CTRL1_USER_ERASE:
+                    self.erase_flash()
+                if data & CHIPAP_CTRL1_CORE_RESET:
+                    self.halted = True
+                self.chipap_ctrl1 = data & ~CHIPAP_CTRL1_USER_ERASE
+        elif apsel == 0:
+            if reg == 0x00:
+                self.csw = data
+            elif reg == 0x04:
+                self.tar = data
+            elif reg == 0x0C:
+                self._write_drw(data)
+                self._next_tar()
+            elif reg in (0x10, 0x14, 0x18, 0x1C):
+                self.write32((self.tar & ~0xF) | (reg & 0x0C), data)
+
+    def dap_read(self, address):
+        if not address & 0x01:
+            if address & 0x0C == 0x00:
+                return DP_IDCODE_VALUE
+            if address & 0x0C == 0x04:
+                return self.ctrlstat | (self.ctrlstat << 1) & 0xA0000000
+            return 0
+        apsel = self.select >> 24
+        reg = (self.select & 0xF0) | (address & 0x0C)
+        if apsel == CHIPAP_APSEL:
+            if reg == 0x00:
+                return self.chipap_ctrl1
+            if reg == 0xFC:
+                return CHIPAP_ID_VALUE
+            return 0
+        if apsel == 0:
+            if reg == 0x00:
+                return self.csw
+            if reg == 0x04:
+                return self.tar
+            if reg == 0x0C:
+                # Narrow reads return the whole word, valid in their lanes
+                value = self.read32(self.tar & ~3)
+                self._next_tar()
+                return value
+            if reg in (0x10, 0x14, 0x18, 0x1C):
+                return self.read32((self.tar & ~0xF) | (reg & 0x0C))
+        return 0
+
+
+class SimTransport:
+    """
+    Adapter handle of the simulated backend.
+
+    :param latency: round trip time added to virtual_time per transfer batch
+    :param transfer_time: time per DAP transfer added to virtual_time
+    """
+
+    def __init__(self, library, latency=ROUND_TRIP_TIME, transfer_time=TRANSFER_TIME):
+        self.library = library
+        self.latency = latency
+        self.transfer_time = transfer_time
+        self.index = None
+        self.target = None
+        self.connected = False
+        self.queue = []
+        self.reset_stats()
+
+    def __str__(self):
+        return "Sim:" + str(self.index)
+
+    def reset_stats(self):
+        self.round_trips = 0
+        self.transfers = 0
+        self.virtual_time = 0.0
+
+    def _round_trip(self, transfers):
+        self.round_trips += 1
+        self.transfers += transfers
+        self.virtual_time += self.latency + transfers * self.transfer_time
+
+    def _check(self):
+        if self.target is None:
+            # 0x81 : "ADI_STATUS_HWIF_DEVICE_NOT_OPENED"
+            raise _error(0x81)
+
+    def Open(self, index, debug=True):
+        self.target = self.library.claim(index)
+        self.index = index
+
+    def Close(self):
+        if self.target is not None:
+            self.library.release(self.index)
+        self.target = None
+        self.index = None
+        self.connected = False
+        self.queue = []
+
+    def IsOpened(self):
+        return self.target is not None
+
+    def GetOpenedAttributes(self):
+        return self.library.GetAttributes(self.index)
+
+    def GetOpenedSerial(self):
+        return self.library.serial(self.index)
+
+    def GetBootloaderVersion(self):
+        return 0
+
+    def GetDebugVersion(self):
+        return 0
+
+    def GetDeviceMode(self):
+        import adi
+        return adi.ADI_DEVICE_MODE.DEBUG_ARM
+
+    def SetDeviceMode(self, mode):
+        pass
+
+    def GetProperty(self, prop_id):
+        return 0
+
+    def SetProperty(self, prop_id, value):
+        pass
+
+    def ConnectJTAG(self):
+        return self.ConnectSWD()
+
+    def ConnectSWD(self, swj=1, baud=0):
+        self._check()
+        self.connected = True
+        self._round_trip(1)
+        return DP_IDCODE_VALUE
+
+    def Disconnect(self):
+        self.connected = False
+
+    def IsConnected(self):
+        return self.connected
+
+    def ClearErrors(self):
+        return tuple([0, 0])
+
+    def LineReset(self):
+        self._round_trip(0)
+
+    def QueueRead(self, address):
+        self._check()
+        self.queue.append((address | 0x02, None))
+
+    def QueueWrite(self, address, data):
+        self._check()
+        self.queue.append((address, data))
+
+    def StartTransfers(self):
+        self._check()
+        queue = self.queue
+        self.queue = []
+        words = []
+        for address, data in queue:
+            if data is None:
+                words.append(self.target.dap_read(address))
+            else:
+                self.target.dap_write(address, data)
+        self._round_trip(len(queue))
+        return words
+
+    def RepeatRead(self, count=1, address=0x0D, buffer=None):
+        self._check()
+        words = [self.target.dap_read(address | 0x02) for x in range(count)]
+        self._round_trip(count)
+        if buffer is not None:
+            view = memoryview(buffer).cast('B').cast('I')
+            view[:count] = array.array('I', words)
+            return buffer
+        return words
+
+    def RepeatWrite(self, data, address=0x0D):
+        self._check()
+        try:
+            view = memoryview(data).cast('B')
+        except TypeError:
+            view = None
+        if view is not None:
+            words = array.array('I')
+            words.frombytes(view[:len(view) // 4 * 4])
+            if sys.byteorder != 'little':
+                words.byteswap()
+        else:
+            words = data
+        for word in words:
+            self.target.dap_write(address, word)
+        self._round_trip(len(words))
+
+
+class SimLibrary:
+    """The set of simulated adapters, one target each."""
+
+    version = "0.0.0"
+
+    def __init__(self, count=1):
+        self.targets = [SimTarget() for x in range(count)]
+        self.opened = set()
+
+    def serial(self, index):
+        return "SIM%04d" % index
+
+    def _check_index(self, index):
+        if not 0 <= index < len(self.targets):
+            # 0x80 : "ADI_STATUS_HWIF_DEVICE_NOT_FOUND"
+            raise _error(0x80)
+
+    def GetNumDevices(self):
+        return len(self.targets)
+
+    def GetSerial(self, index):
+        self._check_index(index)
+        if index in self.opened:
+            # 0x82 : "ADI_STATUS_HWIF_DEVICE_ERROR"
+            raise _error(0x82)
+        return self.serial(index)
+
+    def GetAttributes(self, index):
+        import adi
+        self._check_index(index)
+        return tuple([adi.ADI_VID.SLAB, adi.ADI_PID.UDA, 0])
+
+    def IsAvailable(self, index):
+        return 0 <= index < len(self.targets) and index not in self.opened
+
+    def claim(self, index):
+        self.GetSerial(index)
+        self.opened.add(index)
+        return self.targets[index]
+
+    def release(self, index):
+        self.opened.discard(index)
+
+    def NewTransport(self):
+        return SimTransport(self)
@@ -0,0 +1,255 @@
+
+"""
+Programming station: every connected debug adapter programs and verifies
+its board at the same time.
+
+Each board runs in its own worker, a thread or with -p a process, which
+opens the adapter by serial number and holds that handle for the whole
+cycle. SLAB_ADI calls release the GIL, so threads are enough unless the
+host side work (image conversion, verify) becomes the bottleneck.
+
+Usage: python station.py [-s] [-p] [-a address] [-k start:end] [-e page|mass]
+	[--no-erase] [--no-run] [image]
+
+Each piece of the image goes to SRAM or flash by its own address, so an ELF
+linked for SRAM needs no -s. -s and -a only give the load address of a .bin.
+An image that starts in SRAM is run from there, others by a reset.
+
+Flash is erased by the plan of plan_erase() in si32FlashProgrammer.py: page
+erase of the pages the image covers or a mass erase, whichever is predicted
+to be faster. -k keeps a range of user data (repeatable), -e forces a plan.
+
+The report has one line per board with the time of each phase, then the
+station totals: boards passed, wall time and throughput. The phase records
+of every board are tagged with its serial (see phase_timing.py).
+"""
+
+import argparse
+import concurrent.futures
+import sys
+import time
+
+import adi
+import image
+import phase_timing
+import si32FlashProgrammer as prog
+import target_memory
+from si32FlashProgrammer import SRAM_ADDR, FLASH_ADDR, FLASH_SIZE, DHCSR, DEMCR, AIRCR
+
+PHASES = ('connect', 'halt', 'erase', 'write', 'verify', 'run')
+
+class BoardResult:
+	"""Outcome of one board: pass/fail, the error and seconds per phase."""
+
+	def __init__(self, serial):
+		self.serial = serial
+		self.ok = False
+		self.error = ''
+		self.phases = {}
+		self.bytes = 0
+		self.records = []
+		self.erase_plan = None
+
+	@property
+	def cycle(self):
+		return sum(self.phases.values())
+
+	@property
+	def throughput(self):
+		"""Image bytes per second of write and verify."""
+		busy = self.phases.get('write', 0) + self.phases.get('verify', 0)
+		return self.bytes / busy if busy else 0
+
+class PhaseClock:
+	"""Charges the time since the previous mark to a phase, in the result
+	and as a phase_timing record."""
+
+	def __init__(self, result):
+		self.result = result
+		self.last = time.monotonic()
+
+	def mark(self, phase):
+		now = time.monotonic()
+		self.result.phases[phase] = self.result.phases.get(phase, 0) + now - self.last
+		phase_timing.recorder.add(phase, self.last, now - self.last)
+		self.last = now
+
+def in_sram(address):
+	"""True for an address in the SiM3U1x7 SRAM."""
+	return SRAM_ADDR <= address < SRAM_ADDR + target_memory.SRAM_SIZE
+
+def in_flash(address):
+	"""True for an address in the SiM3U1x7 flash."""
+	return FLASH_ADDR <= address < FLASH_ADDR + FLASH_SIZE
+
+def verify_words(uda, address, words):
+	"""Read words back from address, returns the number of mismatches."""
+
+	recv = prog.swd_read_mem(uda, address, len(words))
+	if recv == words:
+		return 0
+	return sum(1 for a, b in zip(recv, words) if a != b)
+
+def program_board(serial, filename, address, erase=True, run=True, preserve=(), erase_mode=None):
+	"""Program and verify the board behind the adapter with this serial.
+	Returns a BoardResult, errors are reported in it rather than raised."""
+
+	with phase_timing.tagged(serial):
+		with phase_timing.phase('cycle'):
+			result = program_one(serial, filename, address, erase, run, preserve, erase_mode)
+	# The records of a worker process go back with the result
+	result.records = [r for r in phase_timing.recorder.records if r['tag'] == serial]
+	return result
+
+def program_one(serial, filename, address, erase, run, preserve, erase_mode):
+	result = BoardResult(serial)
+	uda = prog.DapSession(adi.AdiDevice())
+	img = None
+	try:
+		clock = PhaseClock(result)
+		uda.OpenBySerial(serial)
+		uda.ConnectSWD()
+		uda.LineReset()
+		prog.write_DAP(uda, prog.MEMAP_BANK_0, prog.DP_CTRLSTAT, 0x50000000)
+		clock.mark('connect')
+
+		prog.connect_and_halt_core(uda)
+		prog.enable_flashctrl_clock(uda)
+		clock.mark('halt')
+
+		img = image.Image(filename, address)
+		pieces = img.words()
+		for piece_address, words in pieces:
+			if not in_sram(piece_address) and not in_flash(piece_address):
+				raise ValueError('piece at 0x%08x is neither in flash nor in SRAM' % piece_address)
+		if erase and any(in_flash(piece_address) for piece_address, words in pieces):
+			result.erase_plan = prog.plan_erase(img, preserve, mode=erase_mode)
+			result.erase_plan.run(uda)
+			clock.mark('erase')
+
+		result.bytes = img.size
+		for piece_address, words in pieces:
+			if in_sram(piece_address):
+				prog.swd_write_mem(uda, piece_address, words)
+			else:
+				prog.write_sequential_words(uda, piece_address, words, len(words))
+		# .bss in SRAM, so the startup of an image run from SRAM may skip the clear
+		zeros = [(fill_address, [0] * count) for fill_address, count in img.fill_words()
+			if in_sram(fill_address)]
+		for fill_address, words in zeros:
+			prog.swd_write_mem(uda, fill_address, words)
+		clock.mark('write')
+
+		errors = 0
+		for piece_address, words in pieces + zeros:
+			errors += verify_words(uda, piece_address, words)
+		clock.mark('verify')
+		if errors:
+			result.error = '%d words differ' % errors
+			return result
+
+		if run:
+			vector_address, vectors = pieces[0]
+			if in_sram(vector_address):
+				prog.swd_write_mem(uda, 0xE000ED08, [vector_address], 1)
+				prog.swd_write_core_register(uda, 13, vectors[0])
+				prog.swd_write_core_register(uda, 15, vectors[1] & 0xFFFFFFFE)
+				prog.write_AHB(uda, DHCSR, 0xA05F0000)
+			else:
+				# Reset into the new code without the reset vector catch
+				prog.write_AHB(uda, DEMCR, 0x0)
+				prog.write_AHB(uda, DHCSR, 0xA05F0000)
+				prog.write_AHB(uda, AIRCR, 0x05FA0004)
+			clock.mark('run')
+		result.ok = True
+	except (adi.AdiError, image.ImageError, OSError, ValueError) as e:
+		result.error = str(e)
+	finally:
+		if img is not None:
+			img.close()
+		try:
+			if uda.IsOpened():
+				prog.write_DAP(uda, prog.MEMAP_BANK_0, prog.DP_CTRLSTAT, 0x00000000)
+			uda.Close()
+		except adi.AdiError:
+			pass
+	return result
+
+def adapter_serials():
+	"""Serial numbers of all adapters that are not open elsewhere."""
+
+	serials = []
+	for i in range(adi.GetNumDevices()):
+		try:
+			serials.append(adi.GetSerial(i))
+		except adi.AdiError:
+			continue
+	return serials
+
+def run_station(filename, address=FLASH_ADDR, serials=None, processes=False, erase=True, run=True,
+		preserve=(), erase_mode=None):
+	"""Program all boards concurrently, returns (results, wall seconds)."""
+
+	if serials is None:
+		serials = adapter_serials()
+	if not serials:
+		return [], 0
+	if processes:
+		pool = concurrent.futures.ProcessPoolExecutor(len(serials))
+	else:
+		pool = concurrent.futures.ThreadPoolExecutor(len(serials))
+	start = time.monotonic()
+	with pool:
+		futures = [pool.submit(program_board, serial, filename, address, erase, run, preserve, erase_mode)
+			for serial in serials]
+		results = [f.result() for f in futures]
+	if processes:
+		for r in results:
+			phase_timing.recorder.records.extend(r.records)
+	return results, time.monotonic() - start
+
+def report(results, wall, out=sys.stdout):
+	"""Print one line per board and the station totals."""
+
+	out.write('%-16s %-4s' % ('serial', 'ok') + ''.join('%9s' % p for p in PHASES) +
+		'%9s %10s  %s\n' % ('cycle', 'bytes/s', 'error'))
+	for r in results:
+		out.write('%-16s %-4s' % (r.serial, 'PASS' if r.ok else 'FAIL') +
+			''.join('%9.3f' % r.phases[p] if p in r.phases else '%9s' % '-' for p in PHASES) +
+			'%9.3f %10.0f  %s\n' % (r.cycle, r.throughput, r.error))
+	passed = sum(1 for r in results if r.ok)
+	total = sum(r.bytes for r in results if r.ok)
+	out.write('%d/%d boards passed in %.3f s, %.0f bytes/s station throughput\n' %
+		(passed, len(results), wall, total / wall if wall else 0))
+	if results:
+		cycles = [r.cycle for r in results]
+		out.write('cycle time min %.3f s, max %.3f s\n' % (min(cycles), max(cycles)))
+	for r in results:
+		if r.erase_plan is not None:
+			out.write('%-16s %s\n' % (r.serial, r.erase_plan.report()))
+
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser(description='Program all connected boards at once.')
+	parser.add_argument('image', nargs='?', default='sim3u1xx_Blinky.bin')
+	parser.add_argument('-a', '--address', type=lambda s: int(s, 0), default=None,
+		help='load address of a .bin (default flash, or SRAM with -s)')
+	parser.add_argument('-s', '--sram', action='store_true', help='load a .bin into SRAM')
+	parser.add_argument('-p', '--processes', action='store_true', help='one process per adapter')
+	parser.add_argument('-k', '--keep', action='append', default=[], metavar='START:END',
+		type=lambda s: tuple(int(x, 0) for x in s.split(':')),
+		help='flash range of user data to preserve')
+	parser.add_argument('-e', '--erase', choices=('page', 'mass'), help='force the erase plan')
+	parser.add_argument('--no-erase', action='store_true')
+	parser.add_argument('--no-run', action='store_true')
+	args = parser.parse_args()
+
+	if args.address is None:
+		args.address = SRAM_ADDR if args.sram else FLASH_ADDR
+	results, wall = run_station(args.image, args.address, processes=args.processes,
+		erase=not args.no_erase, run=not args.no_run, preserve=args.keep, erase_mode=args.erase)
+	if not results:
+		print('No debug adapters found')
+		sys.exit(1)
+	report(results, wall)
+	sys.exit(0 if all(r.ok for r in results) else 1)
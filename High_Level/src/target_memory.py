@@ -0,0 +1,256 @@
+
+"""
+Cached view of target memory.
+
+	mem = TargetMemory(uda)
+	vectors = mem.unpack('<II', SRAM_ADDR)
+	mem[0x20000100:0x20000108] = b'\\x01\\x02\\x03\\x04\\x05\\x06\\x07\\x08'
+	mem.write32(0x20000200, 0x12345678)
+	mem.flush()
+
+Reads of SRAM and flash go through a page cache: a miss reads the whole
+1 KB page (one TAR block) with one RepeatRead. Writes go to a write-back
+buffer and flush() sends each run of adjacent dirty words as one
+swd_write_mem burst. Flash is cached read-only, it is written through
+FLASHCTRL (write_sequential_words) and invalidate() must follow.
+
+Everything outside SRAM and flash, peripherals and the system control space
+included, is uncacheable and goes to the target on every access. Before an
+uncacheable access the write-back buffer is flushed so accesses stay in
+program order. Writing DHCSR or AIRCR can run or reset the core, so the
+cache is also invalidated after such a write.
+
+The core must be halted while the cache is in use.
+"""
+
+import struct
+from array import array
+
+import si32FlashProgrammer as prog
+from image import HOST_LITTLE_ENDIAN
+from si32FlashProgrammer import SRAM_ADDR, FLASH_ADDR, DHCSR, AIRCR
+
+PAGE_SIZE = 0x400
+
+# Cacheable regions of SiM3U1x7: (start, end, writable)
+SRAM_SIZE = 0x8000
+FLASH_SIZE = 0x40000
+REGIONS = (
+	(SRAM_ADDR, SRAM_ADDR + SRAM_SIZE, True),
+	(FLASH_ADDR, FLASH_ADDR + FLASH_SIZE, False),
+)
+
+# Writes to these registers can let the core run or reset it
+RUN_CONTROL_REGISTERS = (DHCSR, AIRCR)
+
+class TargetMemoryError(Exception):
+	pass
+
+def words_to_bytes(words):
+	"""array('I') of target words as little endian bytes."""
+	if not HOST_LITTLE_ENDIAN:
+		words = array('I', words)
+		words.byteswap()
+	return bytearray(words.tobytes())
+
+class Page:
+	"""One cached page. Until loaded only its dirty words are known."""
+
+	def __init__(self):
+		self.data = bytearray(PAGE_SIZE)
+		self.loaded = False
+		self.dirty = set()
+
+class TargetMemory:
+	"""
+	Byte addressed, cached access to target memory.
+
+	:param regions: cacheable (start, end, writable) ranges, REGIONS by
+	 default
+	"""
+
+	def __init__(self, uda, regions=REGIONS):
+		self.uda = uda
+		self.regions = regions
+		self.pages = {}
+		self.hits = 0
+		self.misses = 0
+		self.bursts = 0
+		self.uncached = 0
+
+	def __enter__(self):
+		return self
+
+	def __exit__(self, *args):
+		self.flush()
+
+	#--------------------------------------------------------------------------
+	# Cache
+	#--------------------------------------------------------------------------
+
+	def region(self, address):
+		"""The cacheable region holding address, or None."""
+		for region in self.regions:
+			if region[0] <= address < region[1]:
+				return region
+		return None
+
+	def _page(self, base, load):
+		page = self.pages.get(base)
+		if page is None:
+			page = self.pages[base] = Page()
+		if load and not page.loaded:
+			self.misses += 1
+			data = words_to_bytes(prog.swd_read_mem(self.uda, base, PAGE_SIZE // 4))
+			# Words written before the load are newer than the target
+			for n in page.dirty:
+				data[n * 4:n * 4 + 4] = page.data[n * 4:n * 4 + 4]
+			page.data = data
+			page.loaded = True
+		elif load:
+			self.hits += 1
+		return page
+
+	def flush(self):
+		"""Write all dirty words, each run of adjacent words as one burst."""
+		runs = []
+		for base in sorted(self.pages):
+			page = self.pages[base]
+			for n in sorted(page.dirty):
+				address = base + n * 4
+				word = page.data[n * 4:n * 4 + 4]
+				if runs and runs[-1][0] + len(runs[-1][1]) == address:
+					runs[-1][1].extend(word)
+				else:
+					runs.append((address, bytearray(word)))
+			page.dirty.clear()
+		for address, data in runs:
+			self.bursts += 1
+			prog.swd_write_mem(self.uda, address, data)
+
+	def invalidate(self):
+		"""Drop the cache. Dirty data not flushed is lost."""
+		self.pages = {}
+
+	#--------------------------------------------------------------------------
+	# Access
+	#--------------------------------------------------------------------------
+
+	def _pieces(self, address, length):
+		"""Split a range into (address, length, region) at page and region
+		boundaries."""
+		end = address + length
+		while address < end:
+			region = self.region(address)
+			if region is not None:
+				stop = min(end, region[1], (address & ~(PAGE_SIZE - 1)) + PAGE_SIZE)
+			else:
+				stop = end
+				for start, region_end, writable in self.regions:
+					if address < start < stop:
+						stop = start
+			yield address, stop - address, region
+			address = stop
+
+	def _read_uncached(self, address, length):
+		self.flush()
+		self.uncached += 1
+		first = address & ~3
+		data = words_to_bytes(prog.swd_read_mem(self.uda, first, (address + length - first + 3) // 4))
+		return bytes(data[address - first:address - first + length])
+
+	def _write_uncached(self, address, data):
+		if address & 3 or len(data) & 3:
+			raise TargetMemoryError('uncached writes must be whole words: 0x%08x' % address)
+		self.flush()
+		self.uncached += 1
+		prog.swd_write_mem(self.uda, address, bytes(data))
+		if any(address <= r < address + len(data) for r in RUN_CONTROL_REGISTERS):
+			self.invalidate()
+
+	def read(self, address, length):
+		"""Returns length bytes from address."""
+		out = bytearray()
+		for piece, n, region in self._pieces(address, length):
+			if region is None:
+				out += self._read_uncached(piece, n)
+				continue
+			base = piece & ~(PAGE_SIZE - 1)
+			page = self._page(base, True)
+			out += page.data[piece - base:piece - base + n]
+		return bytes(out)
+
+	def readinto(self, address, buffer):
+		"""Fill a writable buffer from address, returns its size in bytes."""
+		view = memoryview(buffer).cast('B')
+		view[:] = self.read(address, len(view))
+		return len(view)
+
+	def write(self, address, data):
+		"""Write bytes, or any buffer, at address."""
+		data = memoryview(data).cast('B')
+		offset = 0
+		for piece, n, region in self._pieces(address, len(data)):
+			chunk = data[offset:offset + n]
+			offset += n
+			if region is None:
+				self._write_uncached(piece, chunk)
+				continue
+			if not region[2]:
+				raise TargetMemoryError('0x%08x is read-only, use the flash functions' % piece)
+			base = piece & ~(PAGE_SIZE - 1)
+			first = (piece - base) // 4
+			last = (piece - base + n - 1) // 4
+			page = self._page(base, False)
+			if not page.loaded and (piece & 3 or n & 3):
+				# A partial word needs the rest of it from the target
+				if any(w not in page.dirty for w in (first, last)):
+					page = self._page(base, True)
+			page.data[piece - base:piece - base + n] = chunk
+			page.dirty.update(range(first, last + 1))
+
+	def read32(self, address):
+		return struct.unpack('<I', self.read(address, 4))[0]
+
+	def write32(self, address, value):
+		self.write(address, struct.pack('<I', value & 0xFFFFFFFF))
+
+	def unpack(self, fmt, address):
+		"""struct.unpack of the bytes at address."""
+		return struct.unpack(fmt, self.read(address, struct.calcsize(fmt)))
+
+	def pack(self, fmt, address, *values):
+		"""struct.pack values to address."""
+		self.write(address, struct.pack(fmt, *values))
+
+	def __getitem__(self, key):
+		if isinstance(key, slice):
+			if key.step not in (None, 1):
+				raise TargetMemoryError('slices must be contiguous')
+			return self.read(key.start, key.stop - key.start)
+		return self.read(key, 1)[0]
+
+	def __setitem__(self, key, value):
+		if isinstance(key, slice):
+			if key.step not in (None, 1) or len(memoryview(value).cast('B')) != key.stop - key.start:
+				raise TargetMemoryError('slice assignment must not change the size')
+			self.write(key.start, value)
+		else:
+			self.write(key, bytes([value]))
+
+	#--------------------------------------------------------------------------
+	# Run control
+	#--------------------------------------------------------------------------
+
+	def run(self):
+		"""Flush, let the core run and drop the cache."""
+		self.flush()
+		prog.write_AHB(self.uda, DHCSR, 0xA05F0000)
+		self.invalidate()
+
+	def reset(self):
+		"""Flush, reset the core (it halts again if vector catch is set) and
+		drop the cache."""
+		self.flush()
+		prog.write_AHB(self.uda, AIRCR, 0x05FA0004)
+		self.invalidate()
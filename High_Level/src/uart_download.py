@@ -0,0 +1,161 @@
+
+"""
+Host side of the UART0 image streaming protocol implemented by the C8051F380
+adapter firmware (SW_Interface/uart_stream.c).
+
+The image is cut into blocks of BLOCK_WORDS words. Up to WINDOW blocks are
+kept in flight, so the adapter receives the next block while it shifts the
+current one into the target over SWD.
+
+An adapter built with PHASE_TIMING sends its phase log after the GO
+response. The records are added to this run's phase_timing records.
+
+Usage: python uart_download.py <serial port> [image.bin] [baud]
+"""
+
+import binascii
+import json
+import struct
+import sys
+import time
+
+import phase_timing
+
+# Frame constants, must match uart_stream.h
+SOF = 0xA5
+CMD_HALT = ord('H')
+CMD_WRITE = ord('W')
+CMD_GO = ord('G')
+RSP_ACK = ord('K')
+RSP_NAK = ord('N')
+BLOCK_WORDS = 64
+WINDOW = 2
+
+HOST_COMMAND_OK = 0x55
+BAUD_RATE = 1000000
+SRAM_ADDR = 0x20000000
+
+# Seconds to wait for a response before resynchronizing
+RESPONSE_TIMEOUT = 0.5
+MAX_RETRIES = 5
+
+def make_frame(cmd, seq, address, payload=b''):
+	"""Build one frame: SOF, header, payload and CRC16-CCITT (MSB first)."""
+	body = struct.pack('<BBBI', cmd, seq, len(payload) // 4, address) + payload
+	crc = binascii.crc_hqx(body, 0xFFFF)
+	return bytes([SOF]) + body + struct.pack('>H', crc)
+
+class UartStream:
+	"""Windowed frame transfer to the adapter."""
+
+	# Zero bytes that complete any partial frame on the far end
+	RESYNC_BYTES = BLOCK_WORDS * 4 + 9
+
+	def __init__(self, port, baud=BAUD_RATE, ser=None):
+		if ser is None:
+			import serial
+			ser = serial.Serial(port, baud, timeout=RESPONSE_TIMEOUT)
+		self.ser = ser
+		self.seq = 0
+		self.naks = 0
+		self.timeouts = 0
+
+	def close(self):
+		self.ser.close()
+
+	def frame(self, cmd, seq, address, payload):
+		return make_frame(cmd, seq, address, payload)
+
+	def resync(self):
+		"""Complete any partial frame on the adapter and flush stale responses."""
+		self.ser.write(bytes(self.RESYNC_BYTES))
+		time.sleep(RESPONSE_TIMEOUT)
+		self.ser.reset_input_buffer()
+
+	def transfer(self, frames):
+		"""Send (cmd, address, payload) tuples keeping WINDOW frames in flight.
+		Frames answered with NAK or lost are resent."""
+
+		pending = list(frames)
+		pending.reverse()
+		inflight = {}
+		retries = 0
+		while pending or inflight:
+			while pending and len(inflight) < WINDOW:
+				cmd, address, payload = pending.pop()
+				seq = self.seq
+				self.seq = (self.seq + 1) & 0xFF
+				inflight[seq] = (cmd, address, payload)
+				self.ser.write(self.frame(cmd, seq, address, payload))
+
+			rsp = self.ser.read(3)
+			if len(rsp) < 3 or rsp[1] not in inflight:
+				# Lost frame or response, resend everything in flight
+				self.timeouts += 1
+				retries += 1
+				if retries > MAX_RETRIES:
+					raise IOError('adapter not responding')
+				self.resync()
+				for seq in sorted(inflight):
+					pending.append(inflight[seq])
+				inflight.clear()
+				continue
+
+			frame = inflight.pop(rsp[1])
+			if rsp[0] == RSP_ACK and rsp[2] == HOST_COMMAND_OK:
+				retries = 0
+			else:
+				self.naks += 1
+				retries += 1
+				if retries > MAX_RETRIES:
+					raise IOError('block at 0x%08x failed, status 0x%02x' % (frame[1], rsp[2]))
+				pending.append(frame)
+
+	def download(self, address, image, run=True):
+		"""Halt the target, stream image to address and optionally run it."""
+
+		# Pad the tail to a whole word
+		image = bytes(image) + bytes(-len(image) % 4)
+		block = BLOCK_WORDS * 4
+		frames = [(CMD_HALT, 0, b'')]
+		for offset in range(0, len(image), block):
+			frames.append((CMD_WRITE, address + offset, image[offset:offset + block]))
+		self.transfer(frames)
+		if run:
+			self.transfer([(CMD_GO, address, b'')])
+
+	def read_records(self):
+		"""Phase records sent by a PHASE_TIMING adapter, until the line is
+		quiet for RESPONSE_TIMEOUT."""
+
+		records = []
+		for line in self.ser.readlines():
+			try:
+				record = json.loads(line.decode('ascii', 'replace'))
+			except ValueError:
+				continue
+			record['run'] = phase_timing.recorder.run
+			records.append(record)
+		return records
+
+
+if __name__ == "__main__":
+	port = sys.argv[1]
+	filename = sys.argv[2] if len(sys.argv) > 2 else "sim3u1xx_Blinky.bin"
+	baud = int(sys.argv[3]) if len(sys.argv) > 3 else BAUD_RATE
+
+	with open(filename, mode='rb') as f:
+		image = f.read()
+
+	link = UartStream(port, baud)
+	try:
+		start = time.time()
+		with phase_timing.phase('download'):
+			link.download(SRAM_ADDR, image)
+		elapsed = time.time() - start
+		print('%d bytes in %.3f s (%.0f bytes/s), %d NAKs, %d timeouts' %
+			(len(image), elapsed, len(image) / elapsed, link.naks, link.timeouts))
+		phase_timing.recorder.records.extend(link.read_records())
+		phase_timing.report(phase_timing.recorder.records, histograms=False)
+	finally:
+		link.close()
@@ -0,0 +1,310 @@
+
+"""
+Host side of the bootloader's UART firmware update
+(Example/sim3u1xx_Bootloader/src/uart_update.c).
+
+The frames are those of uart_download.py, with the payload always padded to
+BLOCK_WORDS words so the bootloader can receive each frame with one DMA
+transfer. WORDS still gives the number of words to write. The update is
+
+	HELLO               within UART_UPDATE_WAIT_MS of reset, at 115200 baud
+	BAUD <rate>         optional, the response still comes at the old rate
+	WRITE <address> ... the image, from USER_CODE_ADDRESS up
+	GO                  run the user code
+
+Each page is erased by the first block that touches it, so the image has to
+be sent in one go.
+
+With 'loopback' for the port, the update runs against LoopbackBootloader
+instead of a serial port. The model parses and checks the frames, keeps a flash that can only
+clear bits until a page is erased, switches baud rate like the bootloader
+and garbles what arrives at the wrong rate. It adds up a virtual time for
+the line and the flash, with the next frame arriving while the previous one
+is programmed, and can corrupt frames or lose responses to exercise the
+recovery paths.
+
+Usage: python uart_update.py <serial port>|loopback image.bin [-b baud]
+	[--corrupt N] [--lose N]
+"""
+
+import argparse
+import binascii
+import random
+import struct
+import sys
+import time
+
+import uart_download
+from uart_download import SOF, RSP_ACK, RSP_NAK, BLOCK_WORDS, HOST_COMMAND_OK
+
+# Must match uart_update.h and config.h of the bootloader
+CMD_HELLO = ord('H')
+CMD_BAUD = ord('B')
+CMD_WRITE = ord('W')
+CMD_GO = ord('G')
+
+STATUS_INVALID = 0x80
+STATUS_FAILED = 0x81
+STATUS_RANGE = 0x86
+STATUS_BAUD = 0x87
+
+HEADER_SIZE = 8
+FRAME_SIZE = HEADER_SIZE + BLOCK_WORDS * 4 + 2
+
+BOOT_BAUD_RATE = 115200
+MAX_BAUD_RATE = 1000000
+USER_CODE_ADDRESS = 0x1000
+TOP_CODE_ADDRESS = 0x3fffc
+
+FLASH_SIZE = 0x40000
+FLASH_PAGE_SIZE = 0x400
+FLASH_USER_END = TOP_CODE_ADDRESS & ~(FLASH_PAGE_SIZE - 1)
+
+class BootloaderLink(uart_download.UartStream):
+	"""Windowed frame transfer to the bootloader."""
+
+	RESYNC_BYTES = FRAME_SIZE
+
+	def __init__(self, port, baud=BOOT_BAUD_RATE, ser=None):
+		uart_download.UartStream.__init__(self, port, baud, ser)
+
+	def frame(self, cmd, seq, address, payload):
+		payload = bytes(payload)
+		body = struct.pack('<BBBI', cmd, seq, len(payload) // 4, address)
+		body += payload + b'\xff' * (BLOCK_WORDS * 4 - len(payload))
+		crc = binascii.crc_hqx(body, 0xFFFF)
+		return bytes([SOF]) + body + struct.pack('>H', crc)
+
+	def hello(self):
+		self.transfer([(CMD_HELLO, 0, b'')])
+
+	def exchange(self, cmd, address=0):
+		"""Send one frame without payload. Returns its response, or None
+		after a resync if the frame or the response got lost."""
+
+		seq = self.seq
+		self.seq = (self.seq + 1) & 0xFF
+		self.ser.write(self.frame(cmd, seq, address, b''))
+		rsp = self.ser.read(3)
+		if len(rsp) < 3 or rsp[1] != seq:
+			self.timeouts += 1
+			self.resync()
+			return None
+		return rsp
+
+	def set_baud(self, baud):
+		"""Move the link to baud. Returns False, staying at the current rate,
+		if the bootloader cannot reach it."""
+
+		old = self.ser.baudrate
+		for retry in range(uart_download.MAX_RETRIES):
+			rsp = self.exchange(CMD_BAUD, baud)
+			if rsp is None:
+				# The bootloader may have switched with only the response lost
+				self.ser.baudrate = baud
+				rsp = self.exchange(CMD_HELLO)
+				if rsp is not None and rsp[0] == RSP_ACK:
+					return True
+				self.ser.baudrate = old
+			elif rsp[0] == RSP_ACK and rsp[2] == HOST_COMMAND_OK:
+				self.ser.baudrate = baud
+				return True
+			elif rsp[2] == STATUS_BAUD:
+				return False
+			else:
+				self.naks += 1
+		return False
+
+	def update(self, image, address=USER_CODE_ADDRESS, baud=None, run=True):
+		"""Write image to flash at address and optionally run it."""
+
+		self.hello()
+		if baud and baud != self.ser.baudrate and not self.set_baud(baud):
+			print('%d baud not reachable, staying at %d' % (baud, self.ser.baudrate))
+
+		image = bytes(image) + bytes(-len(image) % 4)
+		block = BLOCK_WORDS * 4
+		frames = []
+		for offset in range(0, len(image), block):
+			frames.append((CMD_WRITE, address + offset, image[offset:offset + block]))
+		self.transfer(frames)
+		if run:
+			self.transfer([(CMD_GO, address, b'')])
+
+
+class LoopbackBootloader:
+	"""
+	Serial port with a model of the bootloader behind it.
+
+	:param corrupt: flip a bit in every corrupt'th frame received (0: never)
+	:param lose: drop every lose'th response (0: never)
+	"""
+
+	# Roughly the SiM3U1xx flash timing
+	PAGE_ERASE_TIME = 0.020
+	HALFWORD_WRITE_TIME = 0.000020
+	IDLE_TIME = 0.005
+
+	def __init__(self, corrupt=0, lose=0):
+		self.corrupt = corrupt
+		self.lose = lose
+		self.random = random.Random(0)
+		self.flash = bytearray(b'\xff' * FLASH_SIZE)
+		self.erased = set()
+		self.baudrate = BOOT_BAUD_RATE
+		self.device_baud = BOOT_BAUD_RATE
+		self.timeout = uart_download.RESPONSE_TIMEOUT
+		self.rx = bytearray()
+		self.responses = []
+		self.frames = 0
+		self.sent = 0
+		self.go = False
+
+		# Virtual times: host, end of the last byte on the line, end of the
+		# frame being programmed and end of the drain after a bad frame
+		self.clock = 0.0
+		self.line_free = 0.0
+		self.device_free = 0.0
+		self.drain_until = 0.0
+		self.line_time = 0.0
+		self.flash_time = 0.0
+
+	def close(self):
+		pass
+
+	def byte_time(self, baud):
+		return 10.0 / baud
+
+	def write(self, data):
+		start = max(self.clock, self.line_free)
+		self.line_free = start + len(data) * self.byte_time(self.baudrate)
+		self.line_time += self.line_free - start
+		if start < self.drain_until:
+			# Still draining, the line has not been quiet for IDLE_TIME
+			self.drain_until = self.line_free + self.IDLE_TIME
+			return len(data)
+		if self.baudrate != self.device_baud:
+			data = bytes(self.random.randrange(256) for x in data)
+		self.rx += data
+		while len(self.rx) >= FRAME_SIZE:
+			frame, self.rx = bytes(self.rx[:FRAME_SIZE]), self.rx[FRAME_SIZE:]
+			if frame[0] != SOF:
+				self.rx = bytearray()
+				self.drain_until = self.line_free + self.IDLE_TIME
+				break
+			self.receive(frame, self.line_free)
+		return len(data)
+
+	def receive(self, frame, arrival):
+		self.frames += 1
+		if self.corrupt and self.frames % self.corrupt == 0:
+			frame = bytearray(frame)
+			frame[HEADER_SIZE] ^= 1
+		cmd, seq, words, address = struct.unpack_from('<BBBI', frame, 1)
+		start = max(arrival, self.device_free)
+		busy = 0.0
+		baud = None
+
+		if binascii.crc_hqx(frame[1:], 0xFFFF) != 0:
+			status = STATUS_FAILED
+		elif cmd == CMD_HELLO:
+			status = HOST_COMMAND_OK
+		elif cmd == CMD_BAUD:
+			ok = BOOT_BAUD_RATE <= address <= MAX_BAUD_RATE
+			status = HOST_COMMAND_OK if ok else STATUS_BAUD
+			baud = address if ok else None
+		elif cmd == CMD_WRITE:
+			status, busy = self.write_block(address, frame[HEADER_SIZE:HEADER_SIZE + words * 4])
+		elif cmd == CMD_GO:
+			self.go = self.user_code_valid()
+			status = HOST_COMMAND_OK if self.go else STATUS_FAILED
+		else:
+			status = STATUS_INVALID
+
+		self.flash_time += busy
+		self.device_free = start + busy
+		ready = self.device_free + 3 * self.byte_time(self.device_baud)
+		if baud:
+			self.device_baud = baud
+		self.sent += 1
+		if self.lose and self.sent % self.lose == 0:
+			return
+		rsp = RSP_ACK if status == HOST_COMMAND_OK else RSP_NAK
+		self.responses.append((ready, bytes([rsp, seq, status])))
+
+	def write_block(self, address, data):
+		end = address + len(data)
+		if address & 3 or address < USER_CODE_ADDRESS or end > FLASH_USER_END:
+			return STATUS_RANGE, 0.0
+		busy = 0.0
+		for page in range(address // FLASH_PAGE_SIZE, (end - 1) // FLASH_PAGE_SIZE + 1):
+			if data and page not in self.erased:
+				base = page * FLASH_PAGE_SIZE
+				self.flash[base:base + FLASH_PAGE_SIZE] = b'\xff' * FLASH_PAGE_SIZE
+				self.erased.add(page)
+				busy += self.PAGE_ERASE_TIME
+		for offset in range(0, len(data), 4):
+			word = data[offset:offset + 4]
+			if word == b'\xff\xff\xff\xff':
+				continue
+			for x in range(4):
+				self.flash[address + offset + x] &= word[x]
+			busy += 2 * self.HALFWORD_WRITE_TIME
+		if self.flash[address:end] != data:
+			return STATUS_FAILED, busy
+		return HOST_COMMAND_OK, busy
+
+	def user_code_valid(self):
+		sp, pc = struct.unpack_from('<II', self.flash, USER_CODE_ADDRESS)
+		return (sp & 3 == 0 and 0x20000000 < sp <= 0x20008000 and pc & 1
+			and USER_CODE_ADDRESS <= pc & ~1 < FLASH_USER_END)
+
+	def read(self, size):
+		if not self.responses:
+			self.clock += self.timeout
+			return b''
+		ready, rsp = self.responses.pop(0)
+		self.clock = max(self.clock, ready)
+		return rsp[:size]
+
+	def reset_input_buffer(self):
+		# After the host's resync pause
+		self.clock = max(self.clock, self.line_free) + self.timeout
+		self.responses = []
+
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser(description='UART firmware update through the bootloader.')
+	parser.add_argument('port', help="serial port, or 'loopback' for the bootloader model")
+	parser.add_argument('image', help='binary linked for USER_CODE_ADDRESS')
+	parser.add_argument('-b', '--baud', type=int, default=MAX_BAUD_RATE)
+	parser.add_argument('--corrupt', type=int, default=0,
+		help='loopback: corrupt every Nth frame')
+	parser.add_argument('--lose', type=int, default=0,
+		help='loopback: lose every Nth response')
+	args = parser.parse_args()
+
+	with open(args.image, mode='rb') as f:
+		image = f.read()
+
+	model = None
+	if args.port == 'loopback':
+		model = LoopbackBootloader(args.corrupt, args.lose)
+	link = BootloaderLink(args.port, BOOT_BAUD_RATE, model)
+	try:
+		start = time.time()
+		link.update(image, baud=args.baud)
+		elapsed = time.time() - start
+		if model is None:
+			print('%d bytes in %.3f s (%.0f bytes/s), %d NAKs, %d timeouts' %
+				(len(image), elapsed, len(image) / elapsed, link.naks, link.timeouts))
+		else:
+			written = bytes(model.flash[USER_CODE_ADDRESS:USER_CODE_ADDRESS + len(image)])
+			print('%d bytes at %d baud, %d NAKs, %d timeouts, flash %s, %s' %
+				(len(image), model.device_baud, link.naks, link.timeouts,
+				'matches' if written == image else 'DIFFERS',
+				'user code started' if model.go else 'user code NOT started'))
+			print('virtual %.3f s: line busy %.3f s, flash busy %.3f s (%.0f bytes/s)' %
+				(model.clock, model.line_time, model.flash_time, len(image) / model.clock))
+	finally:
+		link.close()
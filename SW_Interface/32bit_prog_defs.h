@@ -18,6 +18,10 @@
 // System clock frequency in Hz
 #define  SYSCLK                 48000000
 
+// UART0 baud rate used for image streaming (must divide SYSCLK / 2 evenly
+// into an 8-bit Timer1 reload value)
+#define  UART_BAUD_RATE         1000000
+
 #define BOOL bit
 #define TRUE (1 == 1)
 #define FALSE (!TRUE)
@@ -159,6 +163,29 @@ SBIT(P1_4, SFR_P1, 4);
 
 typedef unsigned char STATUS;
 
+// Byte position of wire byte n (LE) within a native U32
+extern const U8 code byte_lane[4];
+
+// CRC16-CCITT (poly 0x1021), the table lives in dp_swd.c
+extern const U16 code crc16_table[256];
+#define _UpdateCRC(crc, byte)  crc = (crc << 8) ^ crc16_table[(U8)(crc >> 8) ^ byte]
+
+// Image segment table entry, generated by High_Level/src/bin2c.py
+typedef struct
+{
+    U32 addr;                           // Target address, word aligned
+    U16 words;                          // Segment length in words
+    U16 offset;                         // Word offset of the data in the image
+    U8  flags;                          // SEG_xxx
+    U16 crc;                            // CRC16-CCITT of the segment bytes
+    U32 value;                          // Fill word for SEG_SET
+} SEGMENT;
+
+#define SEG_FILL                0x01    // No data in the image, not shifted
+#define SEG_ENTRY               0x02    // Starts with the vector table
+#define SEG_CRC                 0x04    // crc is valid, verify after programming
+#define SEG_SET                 0x08    // Fill set to value on the target core
+
 //-----------------------------------------------------------------------------
 // SWD-DP Interface Functions
 //-----------------------------------------------------------------------------
@@ -180,4 +207,14 @@ void    SW_ShiftByteOut(U8);
 U8      SW_ShiftByteIn(void);
 void    SW_ShiftReset(void);
 
+//-----------------------------------------------------------------------------
+// Target Programming Functions
+//-----------------------------------------------------------------------------
+void    connect_and_halt_core(void);
+STATUS  write_sequential_words(U32, U32, U32 *);
+void    read_sequential_words(U32, U32, U32 *);
+void    swd_write_core_register(U32, U32 *);
+void    swd_read_core_register(U32, U32 *);
+void    start_target(U32, U32, U32);
+
 #endif // _32BIT_PROG_DEFS
@@ -23,6 +23,7 @@
 
 void WDT_Init (void);
 void SYSCLK_Init (void);
+void UART0_Init (void);
 void PORT_Init (void);
 void Timer0_Init (void);
 void PCA0_Init (void);
@@ -89,6 +90,33 @@ void Oscillator_Init (void)
     CLKSEL    = 0x03;                  // Enable CLKMUL as sysclk
 }
 
+//-----------------------------------------------------------------------------
+// UART0_Init
+//-----------------------------------------------------------------------------
+//
+// Return Value : None
+// Parameters   : None
+//
+// Configure UART0 for 8-N-1 at UART_BAUD_RATE using Timer1 in 8-bit
+// auto-reload mode clocked directly from SYSCLK. At 48 MHz the reload value
+// is exact for 1 Mbaud (and 1.5 Mbaud), so no baud rate error is added on top
+// of the host adapter's own.
+//
+//-----------------------------------------------------------------------------
+void UART0_Init (void)
+{
+   SCON0 = 0x10;                       // 8-bit variable baud rate, RX enabled
+
+   CKCON |= 0x08;                      // Timer1 uses SYSCLK
+   TMOD = (TMOD & 0x0F) | 0x20;        // Timer1 in 8-bit auto-reload mode
+   TH1 = -(SYSCLK / UART_BAUD_RATE / 2);
+   TL1 = TH1;                          // Init Timer1
+   TR1 = 1;                            // Start Timer1
+
+   TI0 = 0;
+   RI0 = 0;
+}
+
 //-----------------------------------------------------------------------------
 // Port_Init UART0
 //-----------------------------------------------------------------------------
@@ -140,7 +168,7 @@ void Port_Init(void)
   P2MDIN = 0xFF;  //                                        D        D
   P2SKIP = 0x0C;  //                                        x        x
 
-  XBR0 = 0x00;                         // Enable UART0 on the crossbar
+  XBR0 = 0x01;                         // Enable UART0 on the crossbar
   XBR1 = 0x40;                         // Enable the crossbar, which also
                                        // enables port outputs
 }
@@ -14,6 +14,14 @@
 //    connector of an SiM3U/C/L.
 // 3) Run the code and observe that transfer_data contains the correct IDCODE
 //    to validate the SW interface.
+// 4) Define UART_STREAMING to download the image from the host over UART0
+//    (P0.4 TX, P0.5 RX) instead of programming the built-in bin_array.h.
+// 5) bin_array.h is generated by High_Level/src/bin2c.py from a .bin, ELF or
+//    Intel HEX file. Its segment table lets one image load to several
+//    regions, and gaps and .bss are not shifted over SWD at all.
+// 6) Define PHASE_TIMING to time each programming phase with Timer3. The log
+//    is sent over UART0 when programming is done, as JSON lines that
+//    High_Level/src/phase_timing.py aggregates.
 //
 //
 
@@ -21,6 +29,8 @@
 #include <C8051F380_defs.h>
 #include "32bit_prog_defs.h"
 #include "Init.h"
+#include "uart_stream.h"
+#include "phase_timing.h"
 #include "bin_array.h"
 //-----------------------------------------------------------------------------
 // Variables Declarations
@@ -117,10 +127,11 @@ void connect_and_halt_core()
     SWD_DAP_Move(0, DAP_SELECT_WR, &rw_data);
 }
 
-void write_sequential_words(U32 addr, U32 len, U32 *rw_data)
+STATUS write_sequential_words(U32 addr, U32 len, U32 *rw_data)
 {
     U32 i, tmp;
     U32 *buf = rw_data;
+    STATUS rtn;
 
     tmp = MEMAP_BANK_0;
     SWD_DAP_Move(0, DAP_SELECT_WR, &tmp);
@@ -128,10 +139,20 @@ void write_sequential_words(U32 addr, U32 len, U32 *rw_data)
     tmp = 0x23000012;
     SWD_DAP_Move(0, MEMAP_CSW, &tmp);
 
-    SWD_DAP_Move(0, MEMAP_TAR, &addr);
+    rtn = SWD_DAP_Move(0, MEMAP_TAR, &addr);
     for (i = 0; i < len; i++) {
-        SWD_DAP_Move(0, MEMAP_DRW_WR, buf++);
+        tmp = SWD_DAP_Move(0, MEMAP_DRW_WR, buf++);
+        // Keep the first error, the rest are usually caused by it
+        if (rtn == HOST_COMMAND_OK) {
+            rtn = tmp;
+        }
+        // TAR only auto increments within a 1 KB block
+        addr += 4;
+        if ((addr & 0x3FF) == 0 && i + 1 < len) {
+            SWD_DAP_Move(0, MEMAP_TAR, &addr);
+        }
     }
+    return rtn;
 }
 
 void read_sequential_words(U32 addr, U32 len, U32 *rw_data)
@@ -148,6 +169,10 @@ void read_sequential_words(U32 addr, U32 len, U32 *rw_data)
     SWD_DAP_Move(0, MEMAP_TAR, &addr);
     for (i = 0; i < len; i++) {
         SWD_DAP_Move(0, MEMAP_DRW_RD, buf++);
+        addr += 4;
+        if ((addr & 0x3FF) == 0 && i + 1 < len) {
+            SWD_DAP_Move(0, MEMAP_TAR, &addr);
+        }
     }
 }
 
@@ -185,29 +210,337 @@ void swd_read_core_register(U32 n, U32 *rw_data)
     SWD_DAP_Move(0, MEMAP_DRW_RD, rw_data);
 }
 
-void programming_sram()
+// Point VTOR at the loaded vector table, load SP and PC from it and release
+// the core from halt.
+void start_target(U32 vtor, U32 sp, U32 pc)
+{
+    write_sequential_words(0xe000ed08, 1, &vtor);
+    pc = pc & 0xFFFFFFFE;
+    swd_write_core_register(15, &pc);
+    swd_write_core_register(13, &sp);
+    vtor = 0xA05F0000;
+    write_sequential_words(DHCSR, 1, &vtor);
+}
+
+//-----------------------------------------------------------------------------
+// Image segments (bin_segments[], see High_Level/src/bin2c.py)
+//-----------------------------------------------------------------------------
+
+#ifndef BIN_SEGMENTS
+// bin_array.h without a segment table holds one image at 0x20000000
+#ifdef BINLZ_SIZE
+#define BIN_IMAGE_WORDS (BINLZ_SIZE / 4)
+#else
+#define BIN_IMAGE_WORDS (sizeof(binraw) / 4)
+#endif
+#define BIN_SEGMENTS    1
+SEGMENT code bin_segments[] = {
+    { 0x20000000, BIN_IMAGE_WORDS, 0, SEG_ENTRY, 0, 0 }
+};
+#endif
+
+#define WORD_BUF_WORDS  16
+
+SEGMENT_VARIABLE (word_buf[WORD_BUF_WORDS], UU32, SEG_XDATA);
+
+// The image data (binraw[] or the decoded binlz[]) is the data of all
+// programmed segments back to back. This shifts len words of it, starting at
+// word pos, into the target, splitting them at segment boundaries.
+STATUS write_image_words(U16 pos, U16 len, U32 *buf)
+{
+    U8 s;
+    U16 n;
+    STATUS rtn = HOST_COMMAND_OK, tmp;
+
+    for (s = 0; s < BIN_SEGMENTS && len; s++) {
+        if ((bin_segments[s].flags & SEG_FILL) ||
+            pos >= bin_segments[s].offset + bin_segments[s].words) {
+            continue;
+        }
+        n = bin_segments[s].offset + bin_segments[s].words - pos;
+        if (n > len) {
+            n = len;
+        }
+        tmp = write_sequential_words(bin_segments[s].addr + (U32)(pos - bin_segments[s].offset) * 4,
+                                     n, buf);
+        if (rtn == HOST_COMMAND_OK) {
+            rtn = tmp;
+        }
+        pos += n;
+        buf += n;
+        len -= n;
+    }
+    return rtn;
+}
+
+// Read segment s back and compare its CRC16-CCITT with the table
+STATUS verify_segment(U8 s)
+{
+    U16 i, crc = 0xFFFF;
+    U8 j, n;
+
+    for (i = 0; i < bin_segments[s].words; i += n) {
+        n = WORD_BUF_WORDS;
+        if (bin_segments[s].words - i < WORD_BUF_WORDS) {
+            n = bin_segments[s].words - i;
+        }
+        read_sequential_words(bin_segments[s].addr + (U32)i * 4, n, &word_buf[0].U32);
+        for (j = 0; j < n * 4; j++) {
+            _UpdateCRC(crc, word_buf[j >> 2].U8[byte_lane[j & 3]]);
+        }
+    }
+    return (crc == bin_segments[s].crc) ? HOST_COMMAND_OK : HOST_COMMAND_FAILED;
+}
+
+//-----------------------------------------------------------------------------
+// Target side fill of SEG_SET segments
+//-----------------------------------------------------------------------------
+
+// Thumb code run on the target, r0 = start, r1 = value, r2 = end
+//   loop: cmp   r0, r2
+//         bcs   done
+//         stmia r0!, {r1}
+//         b     loop
+//   done: bkpt  #0
+U32 code fill_stub[] = { 0xD2014290, 0xE7FBC002, 0xBF00BE00 };
+
+#define FILL_STUB_WORDS (sizeof(fill_stub) / 4)
+#define SRAM_BASE       0x20000000
+#define SRAM_SIZE       0x8000UL        // SiM3U1x7, 32 KB
+#define DHCSR_S_HALT    0x00020000
+
+// DHCSR reads before giving up on the stub reaching its breakpoint
+#define FILL_POLL_COUNT 10000
+
+// Set each SEG_SET segment to its value with a few core register writes
+// instead of shifting every word. The stub is loaded into an SRAM segment
+// that is programmed afterwards anyway, so this must run before
+// write_image_words. Without such a segment the words are shifted as usual.
+STATUS fill_segments()
+{
+    U8 s, i;
+    U16 n, poll;
+    U32 stub = 0, addr, tmp;
+    STATUS rtn = HOST_COMMAND_OK;
+    BOOL loaded = FALSE;
+
+    for (s = 0; s < BIN_SEGMENTS; s++) {
+        // The whole stub must land in SRAM
+        if (!(bin_segments[s].flags & SEG_FILL) && bin_segments[s].addr >= SRAM_BASE &&
+            bin_segments[s].addr <= SRAM_BASE + SRAM_SIZE - FILL_STUB_WORDS * 4 &&
+            bin_segments[s].words >= FILL_STUB_WORDS) {
+            stub = bin_segments[s].addr;
+            break;
+        }
+    }
+
+    for (s = 0; s < BIN_SEGMENTS && rtn == HOST_COMMAND_OK; s++) {
+        if (!(bin_segments[s].flags & SEG_SET)) {
+            continue;
+        }
+        addr = bin_segments[s].addr;
+
+        if (stub == 0) {
+            for (i = 0; i < WORD_BUF_WORDS; i++) {
+                word_buf[i].U32 = bin_segments[s].value;
+            }
+            for (n = 0; n < bin_segments[s].words && rtn == HOST_COMMAND_OK; n += WORD_BUF_WORDS) {
+                i = WORD_BUF_WORDS;
+                if (bin_segments[s].words - n < WORD_BUF_WORDS) {
+                    i = bin_segments[s].words - n;
+                }
+                rtn = write_sequential_words(addr + (U32)n * 4, i, &word_buf[0].U32);
+            }
+            continue;
+        }
+
+        if (!loaded) {
+            rtn = write_sequential_words(stub, FILL_STUB_WORDS, fill_stub);
+            if (rtn != HOST_COMMAND_OK) {
+                // Do not run whatever the failed write left in SRAM
+                break;
+            }
+            loaded = TRUE;
+        }
+        swd_write_core_register(0, &addr);
+        tmp = bin_segments[s].value;
+        swd_write_core_register(1, &tmp);
+        tmp = addr + (U32)bin_segments[s].words * 4;
+        swd_write_core_register(2, &tmp);
+        tmp = stub;
+        swd_write_core_register(15, &tmp);
+        // xPSR.T, the stub is Thumb code
+        tmp = 0x01000000;
+        swd_write_core_register(16, &tmp);
+
+        // Run, the breakpoint halts the core again
+        tmp = 0xA05F0001;
+        write_sequential_words(DHCSR, 1, &tmp);
+        for (poll = 0; poll < FILL_POLL_COUNT; poll++) {
+            read_sequential_words(DHCSR, 1, &tmp);
+            if (tmp & DHCSR_S_HALT) {
+                break;
+            }
+        }
+        if (poll == FILL_POLL_COUNT) {
+            // Stop the core and fail, the segment CRC would not match anyway
+            tmp = 0xA05F0003;
+            write_sequential_words(DHCSR, 1, &tmp);
+            rtn = HOST_COMMAND_FAILED;
+        }
+    }
+    return rtn;
+}
+
+#ifdef BINLZ_SIZE
+//-----------------------------------------------------------------------------
+// Compressed image (binlz[], see High_Level/src/bin2c.py for the format)
+//-----------------------------------------------------------------------------
+
+#define LZ_MIN_MATCH    3
+
+// Decoded bytes go through a 256 byte ring that is also the match history,
+// so the ring index is simply the low byte of lz_pos. Nothing runs in
+// parallel: when a half of the ring fills, lz_put() stops decoding until
+// write_image_words() has shifted that half into the target, then decoding
+// goes on into the other half. The shifted bytes stay in the ring as match
+// history until decoding wraps around and overwrites them.
+#define LZ_RING_WORDS   64
+#define LZ_HALF_WORDS   (LZ_RING_WORDS / 2)
+
+SEGMENT_VARIABLE (lz_ring[LZ_RING_WORDS], UU32, SEG_XDATA);
+U16 lz_pos;
+STATUS lz_rtn;
+
+void lz_put(U8 byte)
 {
-    U32 i, size, count, addr = 0x20000000;
+    U8 i = (U8)lz_pos;
+    STATUS tmp;
+
+    ((U8 xdata *)lz_ring)[(i & 0xFC) | byte_lane[i & 3]] = byte;
+    lz_pos++;
+
+    i = (U8)lz_pos;
+    if ((i & (LZ_HALF_WORDS * 4 - 1)) == 0) {
+        i -= LZ_HALF_WORDS * 4;
+        tmp = write_image_words(lz_pos / 4 - LZ_HALF_WORDS, LZ_HALF_WORDS, &lz_ring[i >> 2].U32);
+        if (lz_rtn == HOST_COMMAND_OK) {
+            lz_rtn = tmp;
+        }
+    }
+}
 
-    size = sizeof(binraw) / 4;
+U8 lz_get(U8 offset)
+{
+    U8 i = (U8)(lz_pos - offset);
 
+    return ((U8 xdata *)lz_ring)[(i & 0xFC) | byte_lane[i & 3]];
+}
+
+U16 lz_length(U16 len, U16 *src)
+{
+    U8 b;
+
+    do {
+        b = binlz[(*src)++];
+        len += b;
+    } while (b == 255);
+    return len;
+}
+
+STATUS lz_decode()
+{
+    U16 src = 0, len;
+    U8 token, offset;
+    STATUS tmp;
+
+    lz_pos = 0;
+    lz_rtn = HOST_COMMAND_OK;
+
+    while (lz_pos < BINLZ_SIZE) {
+        token = binlz[src++];
+
+        // Literals
+        len = token >> 4;
+        if (len == 15) {
+            len = lz_length(len, &src);
+        }
+        while (len--) {
+            lz_put(binlz[src++]);
+        }
 
-    for (i = 0; i < size; i += 1024) {
-        if ((i + 1024) < size) {
-            count = 1024;
-        } else {
-            count = size - i;
+        // Match
+        len = token & 0x0F;
+        if (len == 0 || lz_pos >= BINLZ_SIZE) {
+            continue;
         }
-        write_sequential_words(addr + i * 4, count, &binraw[i]);
+        offset = binlz[src++];
+        if (len == 15) {
+            len = lz_length(len, &src);
+        }
+        len += LZ_MIN_MATCH - 1;
+        while (len--) {
+            lz_put(lz_get(offset));
+        }
+    }
+
+    // Shift out the partial last half (BINLZ_SIZE is a whole number of words)
+    len = lz_pos & (LZ_HALF_WORDS * 4 - 1);
+    if (len) {
+        token = (U8)(lz_pos - len);
+        tmp = write_image_words((lz_pos - len) / 4, len / 4, &lz_ring[token >> 2].U32);
+        if (lz_rtn == HOST_COMMAND_OK) {
+            lz_rtn = tmp;
+        }
+    }
+    return lz_rtn;
+}
+#endif // BINLZ_SIZE
+
+void programming_sram()
+{
+    U8 s;
+    U32 vectors[2];
+    STATUS rtn, tmp;
+
+    TIMING_START(PHASE_FILL);
+    rtn = fill_segments();
+    TIMING_STOP();
+    TIMING_START(PHASE_WRITE);
+#ifdef BINLZ_SIZE
+    tmp = lz_decode();
+#else
+    tmp = write_image_words(0, sizeof(binraw) / 4, binraw);
+#endif
+    TIMING_STOP();
+    if (rtn == HOST_COMMAND_OK) {
+        rtn = tmp;
     }
 
-    write_sequential_words(0xe000ed08, 1, &addr);
-    addr = binraw[1] & 0xFFFFFFFE;
-    swd_write_core_register(15, &addr);
-    addr = binraw[0];
-    swd_write_core_register(13, &addr);
-    addr = 0xA05F0000;
-    write_sequential_words(DHCSR, 1, &addr);
+    // Fill segments are not shifted. bin2c.py marks them all SEG_SET, .bss
+    // with value 0, so fill_segments() has set them already and the CRC
+    // check covers them
+    TIMING_START(PHASE_VERIFY);
+    for (s = 0; s < BIN_SEGMENTS && rtn == HOST_COMMAND_OK; s++) {
+        if (bin_segments[s].flags & SEG_CRC) {
+            rtn = verify_segment(s);
+        }
+    }
+    TIMING_STOP();
+    // Leave the core halted if the image did not make it
+    if (rtn != HOST_COMMAND_OK) {
+        return;
+    }
+
+    for (s = 0; s < BIN_SEGMENTS; s++) {
+        if (bin_segments[s].flags & SEG_ENTRY) {
+            TIMING_START(PHASE_RUN);
+            read_sequential_words(bin_segments[s].addr, 2, vectors);
+            start_target(bin_segments[s].addr, vectors[0], vectors[1]);
+            TIMING_STOP();
+            break;
+        }
+    }
 }
 #endif
 
@@ -221,6 +554,9 @@ void main(void)
     WDT_Init();
     Oscillator_Init();
     Port_Init();
+#ifdef PHASE_TIMING
+    Timing_Init();
+#endif
 
     // These pins are grounded on the CoreSight debug connector
     P1_4 = 0;
@@ -229,6 +565,7 @@ void main(void)
     // There is no debug port connection at this point
     DP_Type = DP_TYPE_NONE;
 
+    TIMING_START(PHASE_CONNECT);
     SWD_Initialize();
     SWD_Configure(DP_TYPE_SWD);
     SWD_Connect();
@@ -244,8 +581,25 @@ void main(void)
     transfer_data = 0x50000000;
     SWD_DAP_Move(0, DAP_CTRLSTAT_WR, &transfer_data);
     SWD_ClearErrors();
+    TIMING_STOP();
+    TIMING_START(PHASE_HALT);
     connect_and_halt_core();
+    TIMING_STOP();
+#ifdef UART_STREAMING
+    // Receive the image from the host over UART0 instead of bin_array.h
+    UART0_Init();
+    TIMING_START(PHASE_STREAM);
+    UART_Stream_Run();
+    TIMING_STOP();
+#else
     programming_sram();
+#endif
+#ifdef PHASE_TIMING
+#ifndef UART_STREAMING
+    UART0_Init();
+#endif
+    Timing_Report();
+#endif
 
     transfer_data = 0x00000000;
     SWD_DAP_Move(0, DAP_CTRLSTAT_WR, &transfer_data);
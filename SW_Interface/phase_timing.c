@@ -0,0 +1,194 @@
+//
+// FILE NAME    : phase_timing.c
+// TARGET MCU   : C8051F380
+// DESCRIPTION  : Programming phase timer and log
+//
+// Timer3 runs from SYSCLK / 12 in 16-bit auto-reload mode and overflows
+// every millisecond; its ISR counts milliseconds. Timing_Now combines that
+// count with the running timer value into microseconds since Timing_Init,
+// which wraps after about 71 minutes.
+//
+// Phases are not nested: TIMING_START closes nothing, TIMING_STOP ends the
+// phase started last. The log is kept in xdata, so it can also be read from
+// the debugger when UART0 is not available.
+//
+#include <compiler_defs.h>
+#include <C8051F380_defs.h>
+#include "32bit_prog_defs.h"
+#include "phase_timing.h"
+
+#ifdef PHASE_TIMING
+
+//-----------------------------------------------------------------------------
+// Internal Constants
+//-----------------------------------------------------------------------------
+
+#define TIMING_COUNTS_PER_MS    (SYSCLK / 12 / 1000)
+#define TIMING_RELOAD           (65536 - TIMING_COUNTS_PER_MS)
+
+// TMR3CN bits
+#define TMR3CN_TF3H             0x80
+#define TMR3CN_TR3              0x04
+
+// EIE1.ET3
+#define EIE1_ET3                0x80
+
+typedef struct
+{
+    U8 phase;
+    U32 start;
+    U32 us;
+} TIMING_RECORD;
+
+//-----------------------------------------------------------------------------
+// Variables Declarations
+//-----------------------------------------------------------------------------
+
+SEGMENT_VARIABLE (timing_log[TIMING_LOG_SIZE], TIMING_RECORD, SEG_XDATA);
+U8 idata timing_count;
+
+static volatile U32 idata timing_ms;
+
+// Names as used by the host side records
+SEGMENT_VARIABLE_SEGMENT_POINTER (phase_name[PHASE_COUNT], char, SEG_CODE, SEG_CODE) =
+{
+    "connect", "halt", "fill", "write", "verify", "run", "stream"
+};
+
+//-----------------------------------------------------------------------------
+// Timer3_ISR
+//-----------------------------------------------------------------------------
+INTERRUPT(Timer3_ISR, INTERRUPT_TIMER3)
+{
+    TMR3CN &= ~TMR3CN_TF3H;
+    timing_ms++;
+}
+
+//-----------------------------------------------------------------------------
+// Timing_Init
+//-----------------------------------------------------------------------------
+//
+// Clears the log and starts the millisecond tick. Enables interrupts.
+//
+void Timing_Init(void)
+{
+    TMR3CN = 0x00;                      // Stop Timer3, SYSCLK / 12
+    TMR3RLL = (U8)TIMING_RELOAD;
+    TMR3RLH = (U8)(TIMING_RELOAD >> 8);
+    TMR3L = TMR3RLL;
+    TMR3H = TMR3RLH;
+    timing_ms = 0;
+    timing_count = 0;
+
+    EIE1 |= EIE1_ET3;
+    EA = 1;
+    TMR3CN |= TMR3CN_TR3;
+}
+
+//-----------------------------------------------------------------------------
+// Timing_Now
+//-----------------------------------------------------------------------------
+//
+// Returns microseconds since Timing_Init.
+//
+U32 Timing_Now(void)
+{
+    U32 ms;
+    UU16 count;
+
+    EIE1 &= ~EIE1_ET3;                  // Hold off the tick while sampling
+    do
+    {
+        count.U8[MSB] = TMR3H;
+        count.U8[LSB] = TMR3L;
+    }
+    while (count.U8[MSB] != TMR3H);
+    ms = timing_ms;
+    // An overflow not yet counted by the ISR, sampled after the reload
+    if ((TMR3CN & TMR3CN_TF3H) && count.U16 < TIMING_RELOAD + TIMING_COUNTS_PER_MS / 2)
+    {
+        ms++;
+    }
+    EIE1 |= EIE1_ET3;
+
+    return ms * 1000 + (count.U16 - TIMING_RELOAD) / (TIMING_COUNTS_PER_MS / 1000);
+}
+
+//-----------------------------------------------------------------------------
+// Timing_Start / Timing_Stop
+//-----------------------------------------------------------------------------
+void Timing_Start(U8 phase)
+{
+    if (timing_count < TIMING_LOG_SIZE)
+    {
+        timing_log[timing_count].phase = phase;
+        timing_log[timing_count].us = 0;
+        timing_log[timing_count].start = Timing_Now();
+    }
+}
+
+void Timing_Stop(void)
+{
+    if (timing_count < TIMING_LOG_SIZE)
+    {
+        timing_log[timing_count].us = Timing_Now() - timing_log[timing_count].start;
+        timing_count++;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Timing_Report
+//-----------------------------------------------------------------------------
+//
+// Sends the log as JSON lines on UART0, which must be initialized and not
+// owned by the streaming ISR.
+//
+static void Timing_PutChar(char c)
+{
+    TI0 = 0;
+    SBUF0 = c;
+    while (!TI0);
+}
+
+static void Timing_PutStr(const char code *s)
+{
+    while (*s)
+    {
+        Timing_PutChar(*s++);
+    }
+}
+
+static void Timing_PutDec(U32 value)
+{
+    char digits[10];
+    U8 n = 0;
+
+    do
+    {
+        digits[n++] = '0' + (char)(value % 10);
+        value /= 10;
+    }
+    while (value);
+    while (n)
+    {
+        Timing_PutChar(digits[--n]);
+    }
+}
+
+void Timing_Report(void)
+{
+    U8 i;
+
+    for (i = 0; i < timing_count; i++)
+    {
+        Timing_PutStr("{\"source\": \"adapter\", \"phase\": \"");
+        Timing_PutStr(phase_name[timing_log[i].phase]);
+        Timing_PutStr("\", \"start_us\": ");
+        Timing_PutDec(timing_log[i].start);
+        Timing_PutStr(", \"us\": ");
+        Timing_PutDec(timing_log[i].us);
+        Timing_PutStr("}\r\n");
+    }
+}
+
+#endif // PHASE_TIMING
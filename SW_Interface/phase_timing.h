@@ -0,0 +1,63 @@
+//-----------------------------------------------------------------------------
+// phase_timing.h
+//-----------------------------------------------------------------------------
+//
+// This file contains public definitions for the programming phase timer.
+//
+// Built with PHASE_TIMING defined, Timer3 ticks every millisecond and each
+// TIMING_START / TIMING_STOP pair logs one phase with microsecond
+// resolution. Timing_Report sends the log over UART0 as JSON lines in the
+// record format of High_Level/src/phase_timing.py. Without PHASE_TIMING the
+// macros compile to nothing.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef PHASE_TIMING_H
+#define PHASE_TIMING_H
+
+//-----------------------------------------------------------------------------
+// Phases
+//-----------------------------------------------------------------------------
+
+enum
+{
+    PHASE_CONNECT,                      // SWD connect and IDCODE
+    PHASE_HALT,                         // connect_and_halt_core
+    PHASE_FILL,                         // Constant segments set on the target
+    PHASE_WRITE,                        // Image words shifted into the target
+    PHASE_VERIFY,                       // Segment CRC read back
+    PHASE_RUN,                          // Start the target
+    PHASE_STREAM,                       // Whole UART streaming session
+    PHASE_COUNT
+};
+
+// Number of phases logged, later ones are dropped
+#define TIMING_LOG_SIZE         16
+
+//-----------------------------------------------------------------------------
+// Exported prototypes
+//-----------------------------------------------------------------------------
+
+#ifdef PHASE_TIMING
+
+extern void Timing_Init (void);
+extern U32 Timing_Now (void);
+extern void Timing_Start (U8 phase);
+extern void Timing_Stop (void);
+extern void Timing_Report (void);
+
+#define TIMING_START(phase)     Timing_Start(phase)
+#define TIMING_STOP()           Timing_Stop()
+
+#else
+
+#define TIMING_START(phase)
+#define TIMING_STOP()
+
+#endif // PHASE_TIMING
+
+#endif // PHASE_TIMING_H
+
+//-----------------------------------------------------------------------------
+// End of File
+//-----------------------------------------------------------------------------
@@ -0,0 +1,257 @@
+//
+// FILE NAME    : uart_stream.c
+// TARGET MCU   : C8051F380
+// DESCRIPTION  : UART0 image streaming into the target over SWD
+//
+// Frames are received by the UART0 interrupt into one of two ping-pong
+// blocks while the main loop shifts the other block into the target. Receive
+// time and SWD shift time therefore overlap instead of adding up. See
+// uart_stream.h for the frame format.
+//
+// Flow control is window based: the adapter answers each frame only after the
+// block holding it has been released, and the host never has more than
+// UART_BLOCK_COUNT frames outstanding. A frame that arrives while no block is
+// free is dropped and counted in rx_overruns; the host resends it after its
+// response timeout. To resynchronize after a timeout the host sends
+// UART_BLOCK_WORDS * 4 + 9 zero bytes, which completes any partial frame
+// (answered with a NAK) and is otherwise ignored while waiting for SOF.
+//
+#include <compiler_defs.h>
+#include <C8051F380_defs.h>
+#include "32bit_prog_defs.h"
+#include "uart_stream.h"
+
+//-----------------------------------------------------------------------------
+// Internal Constants
+//-----------------------------------------------------------------------------
+
+// Block states
+enum { BLOCK_FREE, BLOCK_FILLING, BLOCK_READY };
+
+// Receive states
+enum { RX_SOF, RX_HEADER, RX_PAYLOAD, RX_CRC };
+
+// Number of header bytes following SOF (CMD, SEQ, WORDS, ADDR[4])
+#define RX_HEADER_SIZE  7
+
+typedef struct
+{
+    volatile U8 state;                  // Set by the ISR, polled by UART_Stream_Run
+    U8 cmd;
+    U8 seq;
+    U8 words;
+    UU32 addr;
+    U16 crc;                            // Zero when the frame CRC matched
+    U32 payload[UART_BLOCK_WORDS];
+} UART_BLOCK;
+
+//-----------------------------------------------------------------------------
+// Variables Declarations
+//-----------------------------------------------------------------------------
+
+SEGMENT_VARIABLE (rx_block[UART_BLOCK_COUNT], UART_BLOCK, SEG_XDATA);
+
+// Block being filled by the ISR and block being drained by the main loop
+U8 idata rx_fill;
+U8 idata rx_drain;
+
+// Frames dropped because no block was free
+U8 idata rx_overruns;
+
+static U8 idata rx_state;
+static U16 idata rx_count;
+static U16 idata rx_length;
+static U16 idata rx_crc;
+static VARIABLE_SEGMENT_POINTER (rx_blk, UART_BLOCK, SEG_XDATA);
+
+static volatile bit tx_idle;
+
+//-----------------------------------------------------------------------------
+// UART0_ISR
+//-----------------------------------------------------------------------------
+//
+// Receives one frame byte at a time into the block selected by rx_fill. The
+// CRC is updated per byte here so the main loop only has to check it.
+//
+INTERRUPT(UART0_ISR, INTERRUPT_UART0)
+{
+    U8 byte;
+
+    if (TI0)
+    {
+        TI0 = 0;
+        tx_idle = 1;
+    }
+
+    if (!RI0)
+    {
+        return;
+    }
+    RI0 = 0;
+    byte = SBUF0;
+
+    switch (rx_state)
+    {
+    case RX_SOF:
+        if (byte != UART_SOF)
+        {
+            break;
+        }
+        rx_blk = &rx_block[rx_fill];
+        if (rx_blk->state != BLOCK_FREE)
+        {
+            // Host overran the window, drop the frame
+            rx_overruns++;
+            break;
+        }
+        rx_blk->state = BLOCK_FILLING;
+        rx_crc = 0xFFFF;
+        rx_count = 0;
+        rx_state = RX_HEADER;
+        break;
+
+    case RX_HEADER:
+        _UpdateCRC(rx_crc, byte);
+        switch (rx_count)
+        {
+        case 0: rx_blk->cmd = byte; break;
+        case 1: rx_blk->seq = byte; break;
+        case 2:
+            if (byte > UART_BLOCK_WORDS)
+            {
+                // Not a frame we can hold, wait for the next SOF
+                rx_blk->state = BLOCK_FREE;
+                rx_state = RX_SOF;
+                return;
+            }
+            rx_blk->words = byte;
+            break;
+        default:
+            rx_blk->addr.U8[byte_lane[rx_count - 3]] = byte;
+            break;
+        }
+        if (++rx_count == RX_HEADER_SIZE)
+        {
+            rx_count = 0;
+            rx_length = (U16)rx_blk->words * 4;
+            rx_state = rx_length ? RX_PAYLOAD : RX_CRC;
+        }
+        break;
+
+    case RX_PAYLOAD:
+        _UpdateCRC(rx_crc, byte);
+        ((U8 xdata *)rx_blk->payload)[(rx_count & ~3) + byte_lane[rx_count & 3]] = byte;
+        if (++rx_count == rx_length)
+        {
+            rx_count = 0;
+            rx_state = RX_CRC;
+        }
+        break;
+
+    case RX_CRC:
+        _UpdateCRC(rx_crc, byte);
+        if (++rx_count == 2)
+        {
+            // Hand the block to the main loop and switch to the other one
+            rx_blk->crc = rx_crc;
+            rx_blk->state = BLOCK_READY;
+            rx_fill ^= 1;
+            rx_state = RX_SOF;
+        }
+        break;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// UART_SendByte
+//-----------------------------------------------------------------------------
+//
+// Sends one byte on UART0. TI0 is owned by the ISR, so wait on tx_idle.
+//
+static void UART_SendByte(U8 byte)
+{
+    while (!tx_idle);
+    tx_idle = 0;
+    SBUF0 = byte;
+}
+
+//-----------------------------------------------------------------------------
+// UART_Stream_Run
+//-----------------------------------------------------------------------------
+//
+// Services received frames until a GO command has been executed. The target
+// must already be connected (and normally halted).
+//
+void UART_Stream_Run(void)
+{
+    VARIABLE_SEGMENT_POINTER (blk, UART_BLOCK, SEG_XDATA);
+    U32 vectors[2];
+    STATUS status;
+    U8 rsp = 0, cmd = 0, seq;
+
+    rx_block[0].state = BLOCK_FREE;
+    rx_block[1].state = BLOCK_FREE;
+    rx_fill = 0;
+    rx_drain = 0;
+    rx_overruns = 0;
+    rx_state = RX_SOF;
+    tx_idle = 1;
+
+    ES0 = 1;                            // Enable UART0 interrupts
+    EA = 1;
+
+    do
+    {
+        blk = &rx_block[rx_drain];
+        if (blk->state != BLOCK_READY)
+        {
+            continue;
+        }
+
+        cmd = blk->cmd;
+        seq = blk->seq;
+        status = HOST_COMMAND_OK;
+
+        if (blk->crc != 0)
+        {
+            status = HOST_COMMAND_FAILED;
+        }
+        else
+        {
+            switch (cmd)
+            {
+            case UART_CMD_HALT:
+                connect_and_halt_core();
+                break;
+
+            case UART_CMD_WRITE:
+                // The other block keeps filling while this one is shifted out
+                status = write_sequential_words(blk->addr.U32, blk->words, blk->payload);
+                break;
+
+            case UART_CMD_GO:
+                read_sequential_words(blk->addr.U32, 2, vectors);
+                start_target(blk->addr.U32, vectors[0], vectors[1]);
+                break;
+
+            default:
+                status = HOST_INVALID_COMMAND;
+                break;
+            }
+        }
+        rsp = (status == HOST_COMMAND_OK) ? UART_RSP_ACK : UART_RSP_NAK;
+
+        // Release the block before answering so the host can refill it
+        blk->state = BLOCK_FREE;
+        rx_drain ^= 1;
+
+        UART_SendByte(rsp);
+        UART_SendByte(seq);
+        UART_SendByte(status);
+    }
+    while (!(cmd == UART_CMD_GO && rsp == UART_RSP_ACK));
+
+    // Let the last response finish before disabling the UART interrupt
+    while (!tx_idle);
+    ES0 = 0;
+}
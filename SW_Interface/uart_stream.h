@@ -0,0 +1,52 @@
+//-----------------------------------------------------------------------------
+// uart_stream.h
+//-----------------------------------------------------------------------------
+//
+// This file contains public definitions for the UART0 image streaming
+// protocol.
+//
+// Host to adapter frame (multi-byte fields are little endian, CRC is MSB
+// first):
+//
+//   SOF | CMD | SEQ | WORDS | ADDR[4] | PAYLOAD[WORDS * 4] | CRC16[2]
+//
+// The CRC16 is CCITT (poly 0x1021, init 0xFFFF) over CMD through PAYLOAD.
+// Every frame is answered with RSP_ACK or RSP_NAK, SEQ and a host status code.
+// The host may have at most UART_BLOCK_COUNT frames outstanding, which keeps
+// one frame arriving while the previous one is shifted into the target.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef UART_STREAM_H
+#define UART_STREAM_H
+
+//-----------------------------------------------------------------------------
+// Protocol Constants
+//-----------------------------------------------------------------------------
+
+#define UART_SOF                0xA5
+
+// Commands
+#define UART_CMD_HALT           'H'     // Connect and halt the core
+#define UART_CMD_WRITE          'W'     // Write WORDS words at ADDR
+#define UART_CMD_GO             'G'     // Run from the vector table at ADDR
+
+// Responses
+#define UART_RSP_ACK            'K'
+#define UART_RSP_NAK            'N'
+
+// Receive buffers (ping-pong) and their payload size
+#define UART_BLOCK_COUNT        2
+#define UART_BLOCK_WORDS        64
+
+//-----------------------------------------------------------------------------
+// Exported prototypes
+//-----------------------------------------------------------------------------
+
+extern void UART_Stream_Run (void);
+
+#endif // UART_STREAM_H
+
+//-----------------------------------------------------------------------------
+// End of File
+//-----------------------------------------------------------------------------